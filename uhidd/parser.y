@@ -59,6 +59,8 @@ static struct device_config dconfig, *dconfig_p;
 %token T_DEFAULT
 %token T_MOUSE_ATTACH
 %token T_KBD_ATTACH
+%token T_KBD_DEBOUNCE
+%token T_KBD_MERGE
 %token T_VHID_ATTACH
 %token T_VHID_STRIP_REPORT_ID
 %token T_VHID_DEVNAME
@@ -145,6 +147,8 @@ conf_entry_list
 conf_entry
 	: mouse_attach
 	| kbd_attach
+	| kbd_debounce
+	| kbd_merge
 	| cc_attach
 	| cc_keymap
 	| vhid_attach
@@ -185,6 +189,21 @@ kbd_attach
 	}
 	;
 
+kbd_debounce
+	: T_KBD_DEBOUNCE "=" T_NUM {
+		dconfig.kbd_debounce = $3 > 0 ? $3 : -1;
+	}
+	;
+
+kbd_merge
+	: T_KBD_MERGE "=" T_YES {
+		dconfig.kbd_merge = 1;
+	}
+	| T_KBD_MERGE "=" T_NO {
+		dconfig.kbd_merge = -1;
+	}
+	;
+
 cc_attach
 	: T_CC_ATTACH "=" T_YES {
 		dconfig.cc_attach = ATTACH_YES;
@@ -321,17 +340,11 @@ config_add_keymap_entry(char *usage, char *hex)
 {
 	int i, value;
 
-	if (!strcasecmp(usage, "Reserved"))
-		return;
 	value = strtoul(hex, NULL, 16);
 	if (value > 127)
 		return;
-	for (i = 0; i < usage_consumer_num; i++) {
-		if (!strcasecmp(usage, usage_consumer[i])) {
-			dconfig.cc_keymap[i] = value;
-			break;
-		}
-	}
+	if ((i = usage_consumer_lookup(usage)) >= 0 && i < _MAX_MM_KEY)
+		dconfig.cc_keymap[i] = value;
 }
 
 static void
@@ -417,6 +430,37 @@ config_kbd_attach(struct hid_interface *hi)
 	return (uconfig.gconfig.kbd_attach);
 }
 
+int
+config_kbd_debounce(struct hid_interface *hi)
+{
+	struct device_config *dc;
+	int ms;
+
+	dc = config_find_device(hi->vendor_id, hi->product_id, hi->ndx);
+	if (dc != NULL && dc->kbd_debounce)
+		ms = dc->kbd_debounce;
+	else if (clconfig.kbd_debounce)
+		ms = clconfig.kbd_debounce;
+	else
+		ms = uconfig.gconfig.kbd_debounce;
+
+	return (MAX(ms, 0));
+}
+
+int
+config_kbd_merge(struct hid_interface *hi)
+{
+	struct device_config *dc;
+
+	dc = config_find_device(hi->vendor_id, hi->product_id, hi->ndx);
+	if (dc != NULL && dc->kbd_merge)
+		return (dc->kbd_merge);
+	if (clconfig.kbd_merge)
+		return (clconfig.kbd_merge);
+
+	return (uconfig.gconfig.kbd_merge);
+}
+
 int
 config_vhid_attach(struct hid_interface *hi)
 {
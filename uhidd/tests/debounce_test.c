@@ -0,0 +1,111 @@
+/*-
+ * Copyright (c) 2015 Kai Wang
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * hid_debounce_key() with the clock at 0, past 2^31 ms and past 2^32 ms,
+ * and with keys idle for longer than the wrap period of 32-bit
+ * milliseconds.
+ */
+
+#include <sys/cdefs.h>
+__FBSDID("$FreeBSD$");
+
+#include <sys/param.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "uhidd.h"
+
+#define	WINDOW	20
+#define	NKEY	4
+
+static int fails;
+
+static void
+check(struct hid_debounce *db, uint64_t now, int ndx, int want,
+    const char *what)
+{
+	int r;
+
+	hid_debounce_begin(db, now);
+	r = hid_debounce_key(db, ndx, 1);
+	if (r != want) {
+		printf("FAIL: %s at %ju: suppressed %d, want %d\n", what,
+		    (uintmax_t) now, r, want);
+		fails++;
+	}
+}
+
+static void
+run(uint64_t base)
+{
+	struct hid_debounce db;
+
+	if (hid_debounce_init(&db, WINDOW, NKEY) < 0) {
+		perror("hid_debounce_init");
+		exit(1);
+	}
+
+	check(&db, base, 0, 0, "first transition");
+	check(&db, base + 2, 0, 1, "chatter");
+	if (!db.db_pending || db.db_next != base + WINDOW) {
+		printf("FAIL: deadline at %ju: %ju, want %ju\n",
+		    (uintmax_t) base, (uintmax_t) db.db_next,
+		    (uintmax_t) (base + WINDOW));
+		fails++;
+	}
+	check(&db, base + WINDOW, 0, 0, "end of window");
+	check(&db, base + WINDOW + 1, 1, 0, "other key");
+	check(&db, base + WINDOW + ((uint64_t) 1 << 31), 0, 0,
+	    "idle for 2^31 ms");
+	check(&db, base + WINDOW + ((uint64_t) 3 << 31), 0, 0,
+	    "idle for 2^32 ms");
+	check(&db, base + WINDOW + ((uint64_t) 3 << 31) + 1, 0, 1,
+	    "chatter after idle");
+	if (db.db_cnt[0] != 2) {
+		printf("FAIL: count at %ju: %u, want 2\n", (uintmax_t) base,
+		    db.db_cnt[0]);
+		fails++;
+	}
+
+	free(db.db_last);
+	free(db.db_cnt);
+}
+
+int
+main(void)
+{
+
+	run(1000);
+	run(((uint64_t) 1 << 31) + 12345);
+	run(((uint64_t) 1 << 32) - 5);
+	if (fails)
+		return (1);
+	printf("debounce: ok\n");
+
+	return (0);
+}
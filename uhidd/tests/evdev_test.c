@@ -0,0 +1,223 @@
+/*-
+ * Copyright (c) 2015 Kai Wang
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * HUG_VOLUME deltas replayed through evdev_frame_tap(), alone and
+ * behind a full dispatch batch of keyboard reports while the device is
+ * held, must reach a client that did not read in between whole: every
+ * press and release, in order, and no SYN_DROPPED.
+ *
+ * The driver is included, so that the test can attach a client
+ * without cuse(3).
+ */
+
+#include "uhidd_evdev.c"
+
+#define	KEY_A		30
+#define	KEY_B		48
+#define	KEY_VOLUMEUP	115
+
+int verbose;
+static int fails;
+
+/* Stubs for the parts of uhidd the frame path doesn't use. */
+
+int
+evdev_hid2key(struct hid_key *hk __unused)
+{
+
+	return (-1);
+}
+
+int
+hid_field_get_flags(struct hid_field *hf __unused)
+{
+
+	return (0);
+}
+
+unsigned
+hid_field_get_usage_page(struct hid_field *hf __unused)
+{
+
+	return (0);
+}
+
+void
+hid_parser_stats(struct hid_parser *hp __unused, FILE *fp __unused)
+{
+}
+
+int
+ucuse_init(void)
+{
+
+	return (0);
+}
+
+int
+ucuse_create_worker(void)
+{
+
+	return (0);
+}
+
+int
+ucuse_copy_out_string(const char *s __unused, void *p __unused,
+    int len __unused)
+{
+
+	return (0);
+}
+
+static void *
+get_hid_interface(void *priv)
+{
+
+	return (priv);
+}
+
+static struct evdev_cb cb = {
+	.get_hid_interface = get_hid_interface,
+};
+
+static struct evclient *
+client_alloc(struct evdev_dev *ed)
+{
+	struct evclient *ec;
+
+	if ((ec = calloc(1, sizeof(*ec))) == NULL) {
+		perror("calloc");
+		exit(1);
+	}
+	ec->evdev = ed;
+	ec->head = ec->tail = ec->buf;
+	ec->enabled = 1;
+	pthread_mutex_init(&ec->mtx, NULL);
+	pthread_cond_init(&ec->cv, NULL);
+	LIST_INSERT_HEAD(&ed->clients, ec, next);
+
+	return (ec);
+}
+
+/*
+ * Read everything queued for the client and check it against nkbd
+ * keyboard frames followed by delta volume up taps.
+ */
+static void
+check(struct evclient *ec, int nkbd, int delta, const char *what)
+{
+	static char buf[EVBUF_SZ];
+	struct evmsg *em;
+	int frame, i, len, press, want;
+
+	frame = press = 0;
+	want = -1;
+	while (ec->cc > 0) {
+		len = evclient_dequeue(ec, buf, NULL, EVBUF_SZ);
+		for (i = 0; i < len / (int) EVMSG_SZ; i++) {
+			em = (struct evmsg *)(uintptr_t)(buf + i * EVMSG_SZ);
+			if (em->type == EVTYPE_SYN && em->code == 3) {
+				printf("FAIL: %s: SYN_DROPPED after %d "
+				    "frames\n", what, frame);
+				fails++;
+				return;
+			}
+			if (em->type == EVTYPE_SYN) {
+				frame++;
+				continue;
+			}
+			if (em->type != EVTYPE_KEY || frame < nkbd)
+				continue;
+			/* The taps alternate press and release. */
+			want = (frame - nkbd) % 2 == 0;
+			if (em->code != KEY_VOLUMEUP || em->value != want) {
+				printf("FAIL: %s: frame %d: key %u value %d, "
+				    "want %u %d\n", what, frame, em->code,
+				    em->value, KEY_VOLUMEUP, want);
+				fails++;
+				return;
+			}
+			press += want;
+		}
+	}
+	if (frame != nkbd + 2 * delta || press != delta) {
+		printf("FAIL: %s: %d frames, %d presses, want %d, %d\n", what,
+		    frame, press, nkbd + 2 * delta, delta);
+		fails++;
+	}
+}
+
+static void
+run(int delta, int held)
+{
+	struct evdev_dev *ed;
+	struct evclient *ec;
+	char what[64];
+	int i, nkbd;
+
+	if ((ed = evdev_alloc(&cb, &cb)) == NULL) {
+		perror("evdev_alloc");
+		exit(1);
+	}
+	ec = client_alloc(ed);
+
+	/* The rest of the batch: one report per frame, two keys each. */
+	nkbd = held ? _XFER_BATCH_MAX - 1 : 0;
+	if (held)
+		evdev_hold(ed);
+	for (i = 0; i < nkbd; i++) {
+		evdev_frame_key(ed, 0x70004, KEY_A, i % 2 == 0);
+		evdev_frame_key(ed, 0x70005, KEY_B, i % 2 == 0);
+		evdev_frame_commit(ed);
+	}
+	evdev_frame_tap(ed, 0xc00e9, KEY_VOLUMEUP, delta);
+	if (held)
+		evdev_flush(ed);
+
+	snprintf(what, sizeof(what), "delta %d%s", delta,
+	    held ? " held" : "");
+	check(ec, nkbd, delta, what);
+
+	LIST_REMOVE(ec, next);
+	free(ec);
+	free(ed);
+}
+
+int
+main(void)
+{
+
+	run(10, 0);
+	run(10, 1);
+	run(12, 1);
+	run(60, 1);
+	if (fails)
+		return (1);
+	printf("evdev: ok\n");
+
+	return (0);
+}
@@ -32,8 +32,6 @@ __FBSDID("$FreeBSD$");
 #include <sys/wait.h>
 #include <sys/time.h>
 #include <sys/resource.h>
-#include <dev/usb/usb.h>
-#include <dev/usb/usbhid.h>
 #include <assert.h>
 #include <dirent.h>
 #include <err.h>
@@ -41,10 +39,9 @@ __FBSDID("$FreeBSD$");
 #include <fcntl.h>
 #include <getopt.h>
 #include <libgen.h>
-#include <libusb20.h>
-#include <libusb20_desc.h>
 #include <libutil.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -57,28 +54,36 @@ int verbose = 0;
 enum options {
 	OPTION_EVDEV,
 	OPTION_EVDEVP,
+	OPTION_CAPTURE,
+	OPTION_REPLAY,
+	OPTION_REPLAY_FAST,
 };
 
 static struct option longopts[] = {
 	{"evdev", required_argument, NULL, OPTION_EVDEV},
 	{"evdevp", required_argument, NULL, OPTION_EVDEVP},
+	{"capture", required_argument, NULL, OPTION_CAPTURE},
+	{"replay", required_argument, NULL, OPTION_REPLAY},
+	{"replay-fast", required_argument, NULL, OPTION_REPLAY_FAST},
+	{NULL, 0, NULL, 0},
 };
 
 static int detach = 1;
 static int hidump = 0;
+static const char *capture_file = NULL;
+static char *replay_file = NULL;
 static struct pidfh *pfh = NULL;
 static STAILQ_HEAD(, hid_interface) hilist;
 
 static void	usage(void);
 static void	version(void);
-static int	find_device(const char *dev);
-static int	open_device(const char *dev, struct libusb20_device *pdev);
-static void	open_iface(const char *dev, struct libusb20_device *pdev,
-		    struct libusb20_interface *iface, int i);
-static int	alloc_hid_interface_be(struct hid_interface *hi);
+static struct hid_transport *find_transport(const char *dev);
 static void	*start_hid_interface(void *arg);
+static void	*dispatch_hid_interface(void *arg);
 static int	hid_set_report(void *context, int report_id, char *buf,
 		    int len);
+static void	*stats_task(void *arg);
+static void	write_stats_file(void);
 static void	create_runtime_dir(void);
 static void	remove_runtime_dir(void);
 static void	sighandler(int sig __unused);
@@ -88,11 +93,15 @@ int
 main(int argc, char **argv)
 {
 	struct hid_interface *hi;
-	char *pid_file, *p;
+	struct hid_transport *ht;
+	pthread_t stats_thread;
+	sigset_t sigset;
+	char *pid_file, *p, *dev;
 	pid_t otherpid;
-	int e, eval, opt;
+	int e, eval, opt, fast;
 
 	eval = 0;
+	fast = 0;
 
 	while ((opt = getopt_long(argc, argv, "c:dDhH:kmosuUvV", longopts,
 	    NULL)) != -1) {
@@ -179,6 +188,18 @@ main(int argc, char **argv)
 			}
 			break;
 
+		case OPTION_CAPTURE:
+			capture_file = optarg;
+			break;
+
+		case OPTION_REPLAY_FAST:
+			fast = 1;
+			/* FALLTHROUGH */
+		case OPTION_REPLAY:
+			replay_file = optarg;
+			detach = 0;
+			break;
+
 		default:
 			usage();
 		}
@@ -187,15 +208,26 @@ main(int argc, char **argv)
 	argv += optind;
 	argc -= optind;
 
-	if (*argv == NULL)
+	/* When replaying, the device name defaults to the capture file. */
+	if (*argv != NULL)
+		dev = basename(*argv);
+	else if (replay_file != NULL)
+		dev = basename(replay_file);
+	else
 		usage();
+	if ((dev = strdup(dev)) == NULL) {
+		fprintf(stderr, "strdup failed\n");
+		exit(1);
+	}
+	if (replay_file != NULL)
+		replay_init(replay_file, fast);
 
 	openlog("uhidd", LOG_PID|LOG_PERROR|LOG_NDELAY, LOG_USER);
 
 	config_init();
 
 	/* Check that another uhidd isn't already attached to the device. */
-	if (asprintf(&pid_file, "/var/run/uhidd.%s.pid", basename(*argv)) < 0) {
+	if (asprintf(&pid_file, "/var/run/uhidd.%s.pid", dev) < 0) {
 		syslog(LOG_ERR, "asprintf failed: %m");
 		exit(1);
 	}
@@ -203,7 +235,7 @@ main(int argc, char **argv)
 	if (pfh == NULL) {
 		if (errno == EEXIST) {
 			syslog(LOG_ERR, "uhidd already running on %s, pid: %d.",
-			    *argv, otherpid);
+			    dev, otherpid);
 			exit(1);
 		}
 		syslog(LOG_WARNING, "cannot open or create pidfile");
@@ -231,7 +263,7 @@ main(int argc, char **argv)
 
 	STAILQ_INIT(&hilist);
 
-	if (find_device(basename(*argv)) < 0) {
+	if ((ht = find_transport(dev)) == NULL || ht->ht_enumerate(dev) < 0) {
 		eval = 1;
 		goto uhidd_end;
 	}
@@ -241,36 +273,51 @@ main(int argc, char **argv)
 
 	create_runtime_dir();
 
-	STAILQ_FOREACH(hi, &hilist, next) {
-		if (alloc_hid_interface_be(hi) < 0)
+	if (capture_file != NULL) {
+		if (capture_open(capture_file) < 0) {
+			eval = 1;
 			goto uhidd_end;
-		hi->hp = hid_parser_alloc(hi->rdesc, hi->rsz, hi);
-		if (hi->hp == NULL) {
-			syslog(LOG_ERR, "%s: hid_parser alloc failed",
-			    hi->dev);
-			continue;
 		}
-		hid_parser_set_write_callback(hi->hp, hid_set_report);
-		hid_parser_attach_drivers(hi->hp);
+		STAILQ_FOREACH(hi, &hilist, next)
+			capture_write_desc(hi);
 	}
 
+	/*
+	 * The statistics are written to the runtime directory on SIGUSR1
+	 * (or SIGINFO). The signals are blocked in all the threads and
+	 * handled synchronously by stats_task(), and so are SIGTERM and
+	 * SIGINT from now on, so that terminate() runs in thread context
+	 * and can take the locks of the pending keymap writes.
+	 */
+	sigemptyset(&sigset);
+	sigaddset(&sigset, SIGTERM);
+	sigaddset(&sigset, SIGINT);
+	sigaddset(&sigset, SIGUSR1);
+#ifdef SIGINFO
+	sigaddset(&sigset, SIGINFO);
+#endif
+	pthread_sigmask(SIG_BLOCK, &sigset, NULL);
+	if (pthread_create(&stats_thread, NULL, stats_task, NULL) != 0)
+		syslog(LOG_WARNING, "pthread_create failed: %m");
+
+	/*
+	 * Each interface is brought up (opened, parsed and attached) by
+	 * its own thread, so that an interface starts delivering input as
+	 * soon as it's ready, regardless of the others.
+	 */
 	STAILQ_FOREACH(hi, &hilist, next) {
-		if (hi->hp && hi->hp->hp_attached > 0) {
-			e = pthread_create(&hi->thread, NULL,
-			    start_hid_interface, (void *)hi);
-			if (e) {
-				syslog(LOG_ERR, "pthread_create failed: %m");
-				goto uhidd_end;
-			}
+		e = pthread_create(&hi->thread, NULL, start_hid_interface,
+		    (void *)hi);
+		if (e) {
+			syslog(LOG_ERR, "pthread_create failed: %m");
+			goto uhidd_end;
 		}
 	}
 	STAILQ_FOREACH(hi, &hilist, next) {
-		if (hi->hp && hi->hp->hp_attached > 0) {
-			e = pthread_join(hi->thread, NULL);
-			if (e) {
-				syslog(LOG_ERR, "pthread_join failed: %m");
-				goto uhidd_end;
-			}
+		e = pthread_join(hi->thread, NULL);
+		if (e) {
+			syslog(LOG_ERR, "pthread_join failed: %m");
+			goto uhidd_end;
 		}
 	}
 
@@ -279,6 +326,55 @@ uhidd_end:
 	terminate(eval);
 }
 
+/* ARGSUSED */
+static void *
+stats_task(void *arg __unused)
+{
+	sigset_t sigset;
+	int sig;
+
+	sigemptyset(&sigset);
+	sigaddset(&sigset, SIGTERM);
+	sigaddset(&sigset, SIGINT);
+	sigaddset(&sigset, SIGUSR1);
+#ifdef SIGINFO
+	sigaddset(&sigset, SIGINFO);
+#endif
+	for (;;) {
+		if (sigwait(&sigset, &sig) != 0)
+			break;
+		if (sig == SIGTERM || sig == SIGINT)
+			terminate(1);
+		write_stats_file();
+	}
+
+	return (NULL);
+}
+
+static void
+write_stats_file(void)
+{
+	struct hid_interface *hi;
+	char path[PATH_MAX], tpath[PATH_MAX];
+	FILE *fp;
+
+	hi = STAILQ_FIRST(&hilist);
+	if (hi == NULL || hi->dev == NULL)
+		return;
+
+	snprintf(path, sizeof(path), "/var/run/uhidd.%s/stats", hi->dev);
+	snprintf(tpath, sizeof(tpath), "%s.tmp", path);
+	if ((fp = fopen(tpath, "w")) == NULL) {
+		syslog(LOG_ERR, "fopen %s failed: %m", tpath);
+		return;
+	}
+	STAILQ_FOREACH(hi, &hilist, next)
+		hid_stats_dump(hi, fp);
+	fclose(fp);
+	if (rename(tpath, path) < 0)
+		syslog(LOG_ERR, "rename %s failed: %m", tpath);
+}
+
 static void
 create_runtime_dir(void)
 {
@@ -321,6 +417,7 @@ static void
 terminate(int eval)
 {
 
+	cc_keymap_sync(NULL);
 	pidfile_remove(pfh);
 	remove_runtime_dir();
 
@@ -335,250 +432,51 @@ sighandler(int sig __unused)
 	terminate(1);
 }
 
-static int
-find_device(const char *dev)
+static struct hid_transport *
+find_transport(const char *dev)
 {
-	struct libusb20_backend *backend;
-	struct libusb20_device *pdev;
-	unsigned int bus, addr;
-	int ret;
-
-	if (sscanf(dev, "ugen%u.%u", &bus, &addr) < 2) {
-		syslog(LOG_ERR, "%s not found", dev);
-		return (-1);
-	}
-
-	backend = libusb20_be_alloc_default();
-	if (backend == NULL) {
-		syslog(LOG_ERR, "can not alloc backend");
-		return (-1);
-	}
-
-	ret = 0;
-	pdev = NULL;
-	while ((pdev = libusb20_be_device_foreach(backend, pdev)) != NULL) {
-		if (bus == libusb20_dev_get_bus_number(pdev) &&
-		    addr == libusb20_dev_get_address(pdev)) {
-			ret = open_device(dev, pdev);
-			break;
-		}
-	}
+	int i;
 
-	if (pdev == NULL) {
-		syslog(LOG_ERR, "%s not found", dev);
-		ret = -1;
+	for (i = 0; i < hid_transport_num; i++) {
+		if (hid_transport_list[i]->ht_match(dev))
+			return (hid_transport_list[i]);
 	}
 
-	libusb20_be_free(backend);
+	syslog(LOG_ERR, "%s not found", dev);
 
-	return (ret);
+	return (NULL);
 }
 
-static int
-open_device(const char *dev, struct libusb20_device *pdev)
+struct hid_interface *
+hid_interface_alloc(const char *dev, int ndx)
 {
-	struct libusb20_config *config;
-	struct libusb20_interface *iface;
-	int cndx, e, i;
-
-	e = libusb20_dev_open(pdev, 32);
-	if (e != 0) {
-		syslog(LOG_ERR, "libusb20_dev_open %s failed", dev);
-		return (-1);
-	}
-
-	/*
-	 * Use current configuration.
-	 */
-	cndx = libusb20_dev_get_config_index(pdev);
-	config = libusb20_dev_alloc_config(pdev, cndx);
-	if (config == NULL) {
-		syslog(LOG_ERR, "Can not alloc config for %s", dev);
-		return (-1);
-	}
+	struct hid_interface *hi;
 
-	/*
-	 * Iterate each interface.
-	 */
-	for (i = 0; i < config->num_interface; i++) {
-		iface = &config->interface[i];
-		if (iface->desc.bInterfaceClass == LIBUSB20_CLASS_HID) {
-			PRINT0(1, dev, i, "HID interface\n");
-			open_iface(dev, pdev, iface, i);
-		}
+	hi = calloc(1, sizeof(*hi));
+	if (hi == NULL) {
+		syslog(LOG_ERR, "calloc failed: %m");
+		exit(1);
 	}
+	hi->dev = dev;
+	hi->ndx = ndx;
 
-	free(config);
-
-	return (0);
+	return (hi);
 }
 
-static void
-open_iface(const char *dev, struct libusb20_device *pdev,
-    struct libusb20_interface *iface, int ndx)
+void
+hid_interface_register(struct hid_interface *hi)
 {
-	struct LIBUSB20_DEVICE_DESC_DECODED *ddesc;
-	struct LIBUSB20_CONTROL_SETUP_DECODED req;
-	struct hid_interface *hi;
 	struct hid_interface_driver *hd, *mhd;
-	struct libusb20_endpoint *ep;
-	unsigned char rdesc[16384], buf[64];
-	int desc, ds, e, j, pos, size, match, old_match;
-	uint16_t actlen, buflen;
-
-	/*
-	 * Get report descriptor.
-	 */
+	int j, match, old_match;
 
-	pos = 0;
-	size = iface->extra.len;
-	while (size > 2) {
-		if (libusb20_me_get_1(&iface->extra, pos + 1) == LIBUSB20_DT_HID)
-			break;
-		size -= libusb20_me_get_1(&iface->extra, pos);
-		pos += libusb20_me_get_1(&iface->extra, pos);
-	}
-	if (size <= 2)
-		return;
-	desc = pos + 6;
-	for (j = 0; j < libusb20_me_get_1(&iface->extra, pos + 5);
-	     j++, desc += j * 3) {
-		if (libusb20_me_get_1(&iface->extra, desc) ==
-		    LIBUSB20_DT_REPORT)
-			break;
-	}
-	if (j >= libusb20_me_get_1(&iface->extra, pos + 5))
-		return;
-	ds = libusb20_me_get_2(&iface->extra, desc + 1);
-	PRINT0(1, dev, ndx, "Report descriptor size = %d\n", ds);
-	LIBUSB20_INIT(LIBUSB20_CONTROL_SETUP, &req);
-	req.bmRequestType = LIBUSB20_ENDPOINT_IN |
-	    LIBUSB20_REQUEST_TYPE_STANDARD | LIBUSB20_RECIPIENT_INTERFACE;
-	req.bRequest = LIBUSB20_REQUEST_GET_DESCRIPTOR;
-	req.wValue = LIBUSB20_DT_REPORT << 8;
-	req.wIndex = ndx;
-	req.wLength = ds;
-	e = libusb20_dev_request_sync(pdev, &req, rdesc, &actlen, 0, 0);
-	if (e) {
-		syslog(LOG_ERR, "%s[%d]=> libusb20_dev_request_sync"
-		    " failed", dev, ndx);
-		return;
-	}
+	assert(hi != NULL && hi->ht != NULL);
 
 	/*
 	 * Dump HID report descriptor in human readable form, if requested.
 	 */
 	if (hidump) {
-		PRINT0(0, dev, ndx, "Report descriptor dump:\n");
-		dump_report_desc(rdesc, actlen);
-	}
-
-	/*
-	 * Make sure the interface is in report protocol mode. If it's set in
-	 * boot protocol mode, it's likely that the HID device will only output
-	 * standard(basic) reports that're understood by the BIOS. For example,
-	 * if a keyboard is set in boot protocol mode, it probably will disable
-	 * multimedia key report output on its second interface.
-	 *
-	 * Also note, according to the HID spec, only boot device support this
-	 * feature, so make sure we check the interface subclass before doing
-	 * requets.
-	 */
-	if (iface->desc.bInterfaceSubClass == 1) {
-		LIBUSB20_INIT(LIBUSB20_CONTROL_SETUP, &req);
-		req.bmRequestType = LIBUSB20_ENDPOINT_IN |
-			LIBUSB20_REQUEST_TYPE_CLASS |
-			LIBUSB20_RECIPIENT_INTERFACE;
-		req.bRequest = 0x03; /* GET_PROTOCOL */
-		req.wValue = 0;
-		req.wIndex = ndx;
-		req.wLength = 1;
-		e = libusb20_dev_request_sync(pdev, &req, buf, &buflen, 0, 0);
-		if (e) {
-			syslog(LOG_ERR, "%s[%d]=> libusb20_dev_request_sync"
-			    " failed", dev, ndx);
-			syslog(LOG_ERR, "%s[%d]=> GET_PROTOCOL failed",
-			    dev, ndx);
-			goto alloc_parent;
-		}
-		if (buflen != 1) {
-			syslog(LOG_ERR, "%s[%d]=> GET_PROTOCOL failed: "
-			    "buflen != 1", dev, ndx);
-			goto alloc_parent;
-		}
-		if (buf[0] == 1) {
-			PRINT0(1, dev, ndx, "Interface is in Report "
-			    "Protocol Mode\n");
-			goto alloc_parent;
-		}
-		if (buf[0] != 0) {
-			syslog(LOG_ERR, "%s[%d]=> GET_PROTOCOL failed: "
-			    "invalid data: %u", dev, ndx,
-			    (unsigned) buf[0]);
-			goto alloc_parent;
-		}
-		PRINT0(0, dev, ndx, "Interface is in Boot Protocol Mode, "
-		    "attempt to switch to Report Protocol Mode...\n");
-		LIBUSB20_INIT(LIBUSB20_CONTROL_SETUP, &req);
-		req.bmRequestType = LIBUSB20_ENDPOINT_OUT |
-			LIBUSB20_REQUEST_TYPE_CLASS |
-			LIBUSB20_RECIPIENT_INTERFACE;
-		req.bRequest = 0x0B; /* SET_PROTOCOL */
-		req.wValue = 1;
-		req.wIndex = ndx;
-		req.wLength = 0;
-		e = libusb20_dev_request_sync(pdev, &req, NULL, NULL, 0, 0);
-		if (e) {
-			syslog(LOG_ERR, "%s[%d]=> libusb20_dev_request_sync"
-			    " failed", dev, ndx);
-			syslog(LOG_ERR, "%s[%d]=> SET_PROTOCOL failed",
-			    dev, ndx);
-			goto alloc_parent;
-		}
-		PRINT0(0, dev, ndx, "Interface SET_PROTOCOL ok.\n");
-	}
-
-alloc_parent:
-	/*
-	 * Allocate a hid parent device.
-	 */
-
-	hi = calloc(1, sizeof(*hi));
-	if (hi == NULL) {
-		syslog(LOG_ERR, "calloc failed: %m");
-		exit(1);
-	}
-	hi->dev = dev;
-	hi->pdev = pdev;
-	hi->iface = iface;
-	hi->ndx = ndx;
-	memcpy(hi->rdesc, rdesc, actlen);
-	hi->rsz = actlen;
-	ddesc = libusb20_dev_get_device_desc(pdev);
-	hi->vendor_id = ddesc->idVendor;
-	hi->product_id = ddesc->idProduct;
-
-	/*
-	 * Find the input interrupt endpoint.
-	 */
-
-	for (j = 0; j < iface->num_endpoints; j++) {
-		ep = &iface->endpoints[j];
-		if ((ep->desc.bmAttributes & LIBUSB20_TRANSFER_TYPE_MASK) ==
-		    LIBUSB20_TRANSFER_TYPE_INTERRUPT &&
-		    ((ep->desc.bEndpointAddress & LIBUSB20_ENDPOINT_DIR_MASK) ==
-		    LIBUSB20_ENDPOINT_IN)) {
-			hi->ep = ep->desc.bEndpointAddress;
-			hi->pkt_sz = ep->desc.wMaxPacketSize;
-			PRINT1(1, "Find IN interrupt ep: %#x packet_size="
-			    "%#x\n", hi->ep, hi->pkt_sz);
-			break;
-		}
-	}
-	if (hi->ep == 0) {
-		PRINT1(0, "does not have IN interrupt ep\n");
-		free(hi);
-		return;
+		PRINT1(0, "Report descriptor dump:\n");
+		dump_report_desc(hi->rdesc, hi->rsz);
 	}
 
 	/*
@@ -602,50 +500,10 @@ alloc_parent:
 	STAILQ_INSERT_TAIL(&hilist, hi, next);
 }
 
-static int
-alloc_hid_interface_be(struct hid_interface *hi)
-{
-	struct libusb20_backend *backend;
-	struct libusb20_device *pdev;
-	unsigned int bus, addr, e;
-
-	assert(hi != NULL);
-
-	if (sscanf(hi->dev, "ugen%u.%u", &bus, &addr) < 2) {
-		syslog(LOG_ERR, "%s not found", hi->dev);
-		return (-1);
-	}
-
-	backend = libusb20_be_alloc_default();
-	pdev = NULL;
-	while ((pdev = libusb20_be_device_foreach(backend, pdev)) != NULL) {
-		if (bus == libusb20_dev_get_bus_number(pdev) &&
-		    addr == libusb20_dev_get_address(pdev)) {
-			e = libusb20_dev_open(pdev, 32);
-			if (e != 0) {
-				syslog(LOG_ERR, "%s: libusb20_dev_open failed",
-				    hi->dev);
-				return (-1);
-			}
-			break;
-		}
-	}
-	if (pdev == NULL) {
-		syslog(LOG_ERR, "%s not found", hi->dev);
-		return (-1);
-	}
-
-	hi->pdev = pdev;
-
-	return (0);
-}
-
 int
 hid_handle_kernel_driver(struct hid_parser *hp)
 {
 	struct hid_interface *hi;
-	struct libusb20_device *pdev;
-	int ndx;
 
 	/*
 	 * Check if any kernel driver is attached to this interface.
@@ -653,16 +511,13 @@ hid_handle_kernel_driver(struct hid_parser *hp)
 
 	hi = hid_parser_get_private(hp);
 	assert(hi != NULL);
-	pdev = hi->pdev;
-	ndx = hi->ndx;
-	if (libusb20_dev_kernel_driver_active(pdev, ndx) == 0) {
+	if (hi->ht->ht_kernel_driver_active == NULL)
+		return (0);
+	if (hi->ht->ht_kernel_driver_active(hi)) {
 		PRINT1(0, "Kernel driver is active\n");
 		if (config_detach_kernel_driver(hi) > 0) {
-			if (libusb20_dev_detach_kernel_driver(pdev, ndx) !=
-			    0) {
-				PRINT1(0, "Unable to detach kernel driver: "
-				    "libusb20_dev_detach_kernel_driver "
-				    "failed\n");
+			if (hi->ht->ht_detach_kernel_driver(hi) != 0) {
+				PRINT1(0, "Unable to detach kernel driver\n");
 				if (config_forced_attach(hi) > 0) {
 					PRINT1(0, "Continue anyway\n");
 					return (0);
@@ -692,210 +547,201 @@ static void *
 start_hid_interface(void *arg)
 {
 	struct hid_interface *hi;
-	struct libusb20_transfer *xfer;
-	char *buf;
-	uint32_t actlen;
-	uint8_t x;
-	int e, i;
+	struct hid_xfer_batch xb;
+	struct hid_xfer *hx;
+	int dispatching, i, j, n, put, r;
 
 	hi = arg;
 	assert(hi != NULL);
 
+	xb.xb_buf = NULL;
+	dispatching = 0;
+
 	/*
-	 * Start receiving data from the endpoint.
+	 * Open the interface, parse the report descriptor and attach
+	 * drivers.
 	 */
 
-	PRINT1(1, "HID interface task started\n");
+	if (hi->ht->ht_open(hi) < 0)
+		goto parent_end;
 
-	if ((buf = malloc(_TR_BUFSIZE)) == NULL) {
-		syslog(LOG_ERR, "%s[%d] malloc failed\n", hi->dev,
-		    hi->ndx);
+	/*
+	 * The ring exists before the drivers attach, as they may hand
+	 * work to the dispatch thread with hid_ring_notify() right away.
+	 */
+	hi->ring = hid_ring_alloc(_RING_SLOTS,
+	    hi->pkt_sz > 0 ? MIN(hi->pkt_sz, _TR_BUFSIZE) : _TR_BUFSIZE);
+	hi->hp = hid_parser_alloc(hi->rdesc, hi->rsz, hi);
+	if (hi->hp == NULL) {
+		syslog(LOG_ERR, "%s: hid_parser alloc failed", hi->dev);
 		goto parent_end;
 	}
+	hid_parser_set_write_callback(hi->hp, hid_set_report);
+	hid_parser_attach_drivers(hi->hp);
+	if (hi->hp->hp_attached == 0)
+		goto parent_end;
 
-	x = (hi->ep & LIBUSB20_ENDPOINT_ADDRESS_MASK) * 2;
-	x |= 1;			/* IN transfer. */
-	xfer = libusb20_tr_get_pointer(hi->pdev, x);
-	if (xfer == NULL) {
-		syslog(LOG_ERR, "%s[%d] libusb20_tr_get_pointer failed\n",
-		    hi->dev, hi->ndx);
+	/*
+	 * Reports are decoded and passed to the drivers by a separate
+	 * dispatch thread, so that a slow driver never delays the polling
+	 * of the endpoint.
+	 */
+
+	if (pthread_create(&hi->dispatch_thread, NULL, dispatch_hid_interface,
+	    hi) != 0) {
+		syslog(LOG_ERR, "pthread_create failed: %m");
 		goto parent_end;
 	}
+	dispatching = 1;
 
-	e = libusb20_tr_open(xfer, _TR_BUFSIZE, 1, hi->ep);
-	if (e == LIBUSB20_ERROR_BUSY) {
-		PRINT1(0, "xfer already opened\n");
-	} else if (e) {
-		syslog(LOG_ERR, "%s[%d] libusb20_tr_open failed\n",
-		    hi->dev, hi->ndx);
+	/*
+	 * Start receiving data from the device.
+	 */
+
+	PRINT1(1, "HID interface task started\n");
+
+	xb.xb_max = _XFER_BATCH_MAX;
+	if ((xb.xb_buf = malloc(xb.xb_max * _TR_BUFSIZE)) == NULL) {
+		syslog(LOG_ERR, "%s[%d] malloc failed\n", hi->dev,
+		    hi->ndx);
 		goto parent_end;
 	}
 
+	if (hi->ht->ht_start != NULL && hi->ht->ht_start(hi) < 0)
+		goto parent_end;
+
 	for (;;) {
 
-		if (libusb20_tr_pending(xfer)) {
-			PRINT1(0, "tr pending\n");
-			continue;
+		if ((n = hi->ht->ht_read(hi, &xb)) < 0) {
+			PRINT1(0, " device detached?\n");
+			goto parent_end;
 		}
 
-		libusb20_tr_setup_intr(xfer, buf, hi->pkt_sz, 0);
-
-		libusb20_tr_start(xfer);
-
-		for (;;) {
-			if (libusb20_dev_process(hi->pdev) != 0) {
-				PRINT1(0, " device detached?\n");
-				goto parent_end;
-			}
-			if (libusb20_tr_pending(xfer) == 0)
+		put = 0;
+		for (j = 0; j < n; j++) {
+			hx = &xb.xb_xfer[j];
+			hid_stats_xfer(hi, hx);
+			switch (hx->hx_status) {
+			case HID_XFER_OK:
+				if (verbose > 2) {
+					PRINT1(3, "received data(%d): ",
+					    hx->hx_len);
+					for (i = 0; i < hx->hx_len; i++)
+						printf("%02d ", hx->hx_data[i]);
+					putchar('\n');
+				}
+				capture_write_report(hi, hx);
+				while ((r = hid_ring_put(hi->ring, hx)) < 0 &&
+				    hi->ht->ht_backpressure) {
+					/* Let the consumer drain the ring. */
+					hid_ring_kick(hi->ring);
+					hid_ring_wait(hi->ring);
+				}
+				if (r < 0) {
+					hi->stats.st_overflows++;
+					PRINT1(1, "report ring overflow\n");
+				} else
+					put++;
+				break;
+			case HID_XFER_TIMEDOUT:
+				PRINT1(1, "TIMED OUT\n");
+				break;
+			default:
+				PRINT1(1, "transfer error\n");
 				break;
-			libusb20_dev_wait_process(hi->pdev, -1);
-		}
-
-		switch (libusb20_tr_get_status(xfer)) {
-		case 0:
-			actlen = libusb20_tr_get_actual_length(xfer);
-			if (verbose > 2) {
-				PRINT1(3, "received data(%u): ", actlen);
-				for (i = 0; (uint32_t) i < actlen; i++)
-					printf("%02d ", buf[i]);
-				putchar('\n');
 			}
-			hid_parser_input_data(hi->hp, buf, actlen);
-			break;
-		case LIBUSB20_TRANSFER_TIMED_OUT:
-			PRINT1(1, "TIMED OUT\n");
-			break;
-		default:
-			PRINT1(1, "transfer error\n");
-			break;
 		}
+		if (put > 0)
+			hid_ring_kick(hi->ring);
 	}
 
 parent_end:
 
-	free(buf);
+	if (dispatching) {
+		hid_ring_close(hi->ring);
+		pthread_join(hi->dispatch_thread, NULL);
+		if (replay_file != NULL) {
+			replay_report(hi);
+			hid_stats_dump(hi, stdout);
+		}
+	}
+	if (hi->ring != NULL) {
+		hid_ring_free(hi->ring);
+		hi->ring = NULL;
+	}
+	cc_keymap_sync(hi);
+	if (hi->ht->ht_close != NULL)
+		hi->ht->ht_close(hi);
+	free(xb.xb_buf);
 
 	PRINT1(1, "HID parent exit\n");
 
 	return (NULL);
 }
 
-#if 0
-int
-hid_interrupt_out(void *context, int report_id, char *buf, int len)
+static void *
+dispatch_hid_interface(void *arg)
 {
 	struct hid_interface *hi;
-	struct libusb20_transfer *xfer;
-	uint32_t actlen;
-	uint8_t x;
-	int e, i, size;
+	struct hid_xfer_batch xb;
+	struct hid_xfer *hx;
+	struct timespec t0, t1;
+	int j, n;
 
-	hi = context;
-	assert(hi != NULL && hi->pdev != NULL);
-
-	x = (hi->ep & LIBUSB20_ENDPOINT_ADDRESS_MASK) * 2;
-	xfer = libusb20_tr_get_pointer(hi->pdev, x);
-	if (xfer == NULL) {
-		syslog(LOG_ERR, "%s[%d] libusb20_tr_get_pointer failed\n",
-		    hi->dev, hi->ndx);
-		return (-1);
-	}
-
-	e = libusb20_tr_open(xfer, _TR_BUFSIZE, 1, XXX); /* FIXME */
-	if (e && e != LIBUSB20_ERROR_BUSY) {
-		syslog(LOG_ERR, "%s[%d] libusb20_tr_open failed\n",
-		    hi->dev, hi->ndx);
-		return (-1);
-	}
-
-	if (libusb20_tr_pending(xfer)) {
-		PRINT1(0, "tr pending\n");
-		return (-1);
-	}
-
-	size = len;
-	while (size > 0) {
-
-		libusb20_tr_setup_intr(xfer, buf, len, 0);
-
-		libusb20_tr_start(xfer);
-
-		for (;;) {
-			if (libusb20_dev_process(hi->pdev) != 0) {
-				PRINT1(0, " device detached?\n");
-				return (-1);
-			}
-			if (libusb20_tr_pending(xfer) == 0)
-				break;
-			libusb20_dev_wait_process(hi->pdev, -1);
-		}
-
-		switch (libusb20_tr_get_status(xfer)) {
-		case 0:
-			actlen = libusb20_tr_get_actual_length(xfer);
-			if (verbose > 2) {
-				PRINT1(2, "transfered data(%u): ", actlen);
-				for (i = 0; (uint32_t) i < actlen; i++)
-					printf("%02d ", buf[i]);
-				putchar('\n');
-			}
-			break;
+	hi = arg;
+	assert(hi != NULL);
 
-		case LIBUSB20_TRANSFER_TIMED_OUT:
-			PRINT1(1, "TIMED OUT\n");
-			return (-1);
-		default:
-			PRINT1(1, "transfer error\n");
-			return (-1);
+	xb.xb_max = _XFER_BATCH_MAX;
+	if ((xb.xb_buf = malloc(xb.xb_max * _TR_BUFSIZE)) == NULL) {
+		syslog(LOG_ERR, "%s[%d] malloc failed\n", hi->dev,
+		    hi->ndx);
+		return (NULL);
+	}
+
+	/* No report when woken up by hid_ring_notify(), flush only. */
+	while ((n = hid_ring_get(hi->ring, &xb)) >= 0) {
+		for (j = 0; j < n; j++) {
+			hx = &xb.xb_xfer[j];
+			hi->rx_ts = hx->hx_ts;
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			hid_parser_input_data(hi->hp, hx->hx_data,
+			    hx->hx_len);
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			hid_stats_proc(hi, &t0, &t1);
 		}
 
-		buf += actlen;
-		size -= actlen;
+		/*
+		 * All reports of this wakeup are decoded, now flush the
+		 * drivers' output with one write per sink.
+		 */
+		if (hid_parser_flush(hi->hp))
+			ucuse_poll_wakeup();
 	}
 
-	return (0);
-}
-#endif
+	free(xb.xb_buf);
 
-#define	_SET_REPORT_RETRY	3
+	return (NULL);
+}
 
 static int
 hid_set_report(void *context, int report_id, char *buf, int len)
 {
-	struct LIBUSB20_CONTROL_SETUP_DECODED req;
 	struct hid_interface *hi;
-	uint16_t actlen;
-	int e, i, try;
+	int i;
 
 	hi = context;
-	assert(hi != NULL && hi->pdev != NULL);
+	assert(hi != NULL && hi->ht != NULL);
 
 	printf("hid_set_report (%d)", len);
 	for (i = 0; i < len; i++)
 		printf(" 0x%02x", buf[i]);
 	putchar('\n');
 
-	LIBUSB20_INIT(LIBUSB20_CONTROL_SETUP, &req);
-	req.bmRequestType = LIBUSB20_ENDPOINT_OUT |
-	    LIBUSB20_REQUEST_TYPE_CLASS | LIBUSB20_RECIPIENT_INTERFACE;
-	req.bRequest = 0x09;	/* SET_REPORT */
-	req.wValue = (0x02 << 8) | (report_id & 0xff); /* FIXME report type */
-	req.wIndex = hi->ndx;
-	req.wLength = len;
-	try = 0;
-	do {
-		e = libusb20_dev_request_sync(hi->pdev, &req, buf, &actlen, 0, 0);
-		if (e && verbose)
-			syslog(LOG_ERR, "%s[%d] libusb20_dev_request_sync failed",
-			    hi->dev, hi->ndx);
-		try++;
-	} while (e && try < _SET_REPORT_RETRY);
-	if (e) {
-		syslog(LOG_ERR, "%s[%d] libusb20_dev_request_sync failed",
-		    hi->dev, hi->ndx);
+	/* FIXME report type */
+	if (hi->ht->ht_set_report(hi, HID_REPORT_OUTPUT, report_id, buf,
+	    len) < 0)
 		return (-1);
-	}
+
 	if (verbose) {
 		PRINT1(1, "set_report: id(%d)", report_id);
 		for (i = 0; i < len; i++)
@@ -929,15 +775,13 @@ hid_match_interface(struct hid_interface *hi, int iclass, int isubclass,
 
 	assert(hi != NULL);
 
-	if (iclass >= 0 && (uint8_t) iclass != hi->iface->desc.bInterfaceClass)
+	if (iclass >= 0 && (uint8_t) iclass != hi->iclass)
 		return (0);
 
-	if (isubclass >= 0 &&
-	    (uint8_t) isubclass != hi->iface->desc.bInterfaceSubClass)
+	if (isubclass >= 0 && (uint8_t) isubclass != hi->isubclass)
 		return (0);
 
-	if (iproto >= 0 && (uint8_t)
-	    iproto != hi->iface->desc.bInterfaceProtocol)
+	if (iproto >= 0 && (uint8_t) iproto != hi->iproto)
 		return (0);
 
 	return (1);
@@ -948,7 +792,10 @@ usage(void)
 {
 
 	fprintf(stderr, "usage: uhidd [-c config_file] [-H devname] "
-	    "[-dDhkmosuUvV] /dev/ugen%%u.%%u\n");
+	    "[-dDhkmosuUvV]\n"
+	    "             [--evdev kmo] [--evdevp kmo] [--capture file]\n"
+	    "             [--replay file | --replay-fast file] "
+	    "/dev/ugen%%u.%%u\n");
 	exit(1);
 }
 
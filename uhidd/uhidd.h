@@ -28,6 +28,9 @@
 
 #include <sys/queue.h>
 #include <libgen.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <time.h>
 
 /*
  * HID parser.
@@ -306,6 +309,8 @@ struct device_config {
 	int8_t forced_attach;
 	int8_t vhid_strip_id;
 	char *vhid_devname;
+	int kbd_debounce;
+	int8_t kbd_merge;
 	STAILQ_HEAD(, hidaction_config) haclist;
 	STAILQ_ENTRY(device_config) next;
 };
@@ -330,26 +335,175 @@ enum uhidd_ctype {
 	UHIDD_HID
 };
 
+/*
+ * Per-interface report statistics. Intervals between reports and
+ * report processing times are kept in power-of-two histograms, which
+ * are halved whenever they hold _STATS_WINDOW samples, so they mostly
+ * reflect the recent behavior of the device.
+ */
+
+#define	_STATS_NBUCKET		16
+#define	_STATS_WINDOW		4096
+#define	_STATS_INTVL_BASE	125000	/* ns, first interval bucket */
+#define	_STATS_PROC_BASE	1000	/* ns, first processing bucket */
+
+struct hid_stats {
+	uint64_t		st_reports;
+	uint64_t		st_timeouts;
+	uint64_t		st_errors;
+	uint64_t		st_overflows;
+	uint64_t		st_intvl_cnt;
+	uint64_t		st_intvl_hist[_STATS_NBUCKET];
+	uint64_t		st_proc_cnt;
+	uint64_t		st_proc_hist[_STATS_NBUCKET];
+	uint64_t		st_proc_max;
+	uint64_t		st_intvl_avg;		/* ns, EWMA */
+	uint64_t		st_jitter;		/* ns, EWMA */
+	uint64_t		st_last_intvl;
+	struct timespec		st_last;
+	uint64_t		st_done;		/* Dispatch side. */
+	uint64_t		st_lat_sum;		/* ns, from arrival */
+	uint64_t		st_lat_max;
+	struct timespec		st_done_last;
+};
+
+/*
+ * Latency histogram, updated without locks and cheap enough to be left
+ * on. Each thread counts in its own slot (threads beyond _LAT_NSLOT
+ * share one); the slots are summed when dumped.
+ */
+
+#define	_LAT_NSLOT		4
+#define	_STATS_LAT_BASE		2000	/* ns, first latency bucket */
+
+struct hid_lathist {
+	atomic_uint_fast64_t	lh_hist[_LAT_NSLOT][_STATS_NBUCKET];
+};
+
+/*
+ * One-shot timer, run by the shared timer thread on the monotonic
+ * clock.
+ */
+struct hid_timer {
+	struct timespec		 tm_when;
+	void			(*tm_fn)(void *);
+	void			*tm_arg;
+	int			 tm_armed;
+	TAILQ_ENTRY(hid_timer)	 tm_next;
+};
+
+/*
+ * Per-key switch debounce state. Timestamps are 64-bit milliseconds on
+ * the monotonic clock, so that they never wrap.
+ */
+struct hid_debounce {
+	int			 db_window;	/* In ms, or 0. */
+	uint64_t		*db_last;	/* Last accepted transition. */
+	uint32_t		*db_cnt;	/* Suppressed transitions. */
+	uint64_t		 db_now;
+	uint64_t		 db_next;	/* Earliest end of a window. */
+	unsigned char		 db_pending;
+};
+
+/*
+ * File descriptor watched by the timer thread.
+ */
+struct hid_watch {
+	int			 hw_fd;
+	void			(*hw_fn)(void *);
+	void			*hw_arg;
+	int			 hw_active;
+	TAILQ_ENTRY(hid_watch)	 hw_next;
+};
+
+/*
+ * Number of report slots between an interface thread and its dispatch
+ * thread.
+ */
+#define	_RING_SLOTS		256
+
+struct hid_ring;
+
 struct hid_interface {
 	const char			*dev;
-	struct libusb20_device		*pdev;
-	struct libusb20_interface	*iface;
+	struct hid_transport		*ht;
+	void				*ht_data;
 	int				 vendor_id;
 	int				 product_id;
+	uint8_t				 iclass;
+	uint8_t				 isubclass;
+	uint8_t				 iproto;
 	struct hid_parser		*hp;
 	int				 ndx;
 	unsigned char			 rdesc[_MAX_RDESC_SIZE];
 	int				 rsz;
-	uint8_t				 ep;
 	int				 pkt_sz;
+	uint8_t				 binterval;
+	struct hid_stats		 stats;
+	struct timespec			 rx_ts;	/* Arrival of the report. */
 	uint8_t				 cc_keymap[_MAX_MM_KEY];
 	int				 free_key_pos;
+	uint8_t				 cc_map[_MAX_MM_KEY];	/* Effective. */
+	uint8_t				 cc_map_user;	/* From uhidd.conf. */
+	uint8_t				 cc_keymap_dirty;
+	STAILQ_ENTRY(hid_interface)	 cc_keymap_next;
 	pthread_t			 thread;
+	pthread_t			 dispatch_thread;
+	struct hid_ring			*ring;
 	int (*cc_recv_filter)(struct hid_appcol *, unsigned, int, unsigned *,
 	    int *);
 	STAILQ_ENTRY(hid_interface)	 next;
 };
 
+/*
+ * HID transport.
+ *
+ * A transport is the backend that finds the HID interfaces of a device,
+ * fetches their report descriptors, reads input reports and writes
+ * output/feature reports. ht_read() blocks until at least one report
+ * is available and returns the number of completed transfers put in
+ * the batch, or -1 if the device is gone. A transport which sets
+ * ht_backpressure is never allowed to drop reports: its interface
+ * thread waits for room in the report ring instead.
+ */
+
+#define	_XFER_BATCH_MAX		16
+
+#define	HID_XFER_OK		0
+#define	HID_XFER_TIMEDOUT	1
+#define	HID_XFER_ERROR		2
+
+#define	HID_REPORT_INPUT	1
+#define	HID_REPORT_OUTPUT	2
+#define	HID_REPORT_FEATURE	3
+
+struct hid_xfer {
+	int				 hx_status;
+	int				 hx_len;
+	char				*hx_data;
+	struct timespec			 hx_ts;
+};
+
+struct hid_xfer_batch {
+	int				 xb_max;
+	char				*xb_buf;
+	struct hid_xfer			 xb_xfer[_XFER_BATCH_MAX];
+};
+
+struct hid_transport {
+	const char *ht_name;
+	int (*ht_match)(const char *);
+	int (*ht_enumerate)(const char *);
+	int (*ht_open)(struct hid_interface *);
+	int (*ht_start)(struct hid_interface *);
+	int (*ht_read)(struct hid_interface *, struct hid_xfer_batch *);
+	void (*ht_close)(struct hid_interface *);
+	int (*ht_set_report)(struct hid_interface *, int, int, char *, int);
+	int (*ht_kernel_driver_active)(struct hid_interface *);
+	int (*ht_detach_kernel_driver)(struct hid_interface *);
+	int ht_backpressure;
+};
+
 /*
  * HID driver structures.
  */
@@ -374,6 +528,8 @@ struct hid_appcol_driver {
 	int (*ha_drv_attach)(struct hid_appcol *);
 	void (*ha_drv_recv)(struct hid_appcol *, struct hid_report *);
 	void (*ha_drv_recv_raw)(struct hid_appcol *, uint8_t *, int);
+	int (*ha_drv_flush)(struct hid_appcol *);
+	void (*ha_drv_stats)(struct hid_appcol *, FILE *);
 };
 
 /* evdev callbacks. */
@@ -418,11 +574,15 @@ extern struct uhidd_config uconfig;
 extern struct device_config clconfig;
 extern const char *config_file;
 extern int usage_consumer_num;
-extern const char **usage_consumer;
+extern const char *const *usage_consumer;
 extern const int hid_appcol_driver_num;
 extern const int hid_interface_driver_num;
 extern struct hid_appcol_driver hid_appcol_driver_list[];
 extern struct hid_interface_driver hid_interface_driver_list[];
+extern const int hid_transport_num;
+extern struct hid_transport *hid_transport_list[];
+extern struct hid_transport libusb20_transport;
+extern struct hid_transport replay_transport;
 
 /*
  * Prototypes.
@@ -431,11 +591,15 @@ extern struct hid_interface_driver hid_interface_driver_list[];
 int		cc_match(struct hid_appcol *);
 int		cc_attach(struct hid_appcol *);
 void		cc_recv(struct hid_appcol *, struct hid_report *);
+int		cc_flush(struct hid_appcol *);
+void		cc_keymap_sync(struct hid_interface *);
 void		dump_report_desc(unsigned char *, int);
 void		hexdump_report_desc(unsigned char *, int);
 struct hid_parser *hid_parser_alloc(unsigned char *, int, void *);
 void		hid_parser_free(struct hid_parser *);
 void		hid_parser_input_data(struct hid_parser *, char *, int);
+int		hid_parser_flush(struct hid_parser *);
+void		hid_parser_stats(struct hid_parser *, FILE *);
 void		hid_parser_output_data(struct hid_parser *, int, char *,
 		    int);
 void		*hid_parser_get_private(struct hid_parser *);
@@ -466,6 +630,40 @@ int		hid_field_get_usage_min(struct hid_field *);
 int		hid_field_get_usage_max(struct hid_field *);
 void		hid_field_set_value(struct hid_field *, int, int);
 int		hid_handle_kernel_driver(struct hid_parser *);
+struct hid_interface *hid_interface_alloc(const char *, int);
+void		hid_interface_register(struct hid_interface *);
+int		capture_open(const char *);
+void		capture_write_desc(struct hid_interface *);
+void		capture_write_report(struct hid_interface *, struct hid_xfer *);
+void		replay_init(const char *, int);
+void		replay_report(struct hid_interface *);
+void		hid_stats_xfer(struct hid_interface *, struct hid_xfer *);
+void		hid_stats_proc(struct hid_interface *, struct timespec *,
+		    struct timespec *);
+void		hid_stats_dump(struct hid_interface *, FILE *);
+void		hid_stats_realtime(struct timespec *, struct timeval *);
+int		hid_debounce_init(struct hid_debounce *, int, int);
+void		hid_debounce_begin(struct hid_debounce *, uint64_t);
+int		hid_debounce_key(struct hid_debounce *, int, int);
+void		hid_lathist_add(struct hid_lathist *, struct timespec *);
+void		hid_lathist_add_ns(struct hid_lathist *, uint64_t);
+void		hid_lathist_dump(struct hid_lathist *, FILE *, const char *);
+struct hid_ring	*hid_ring_alloc(int, int);
+void		hid_ring_free(struct hid_ring *);
+int		hid_ring_put(struct hid_ring *, struct hid_xfer *);
+void		hid_ring_kick(struct hid_ring *);
+void		hid_ring_wait(struct hid_ring *);
+void		hid_ring_close(struct hid_ring *);
+void		hid_ring_notify(struct hid_ring *);
+int		hid_ring_get(struct hid_ring *, struct hid_xfer_batch *);
+void		hid_timer_init(struct hid_timer *, void (*)(void *), void *);
+void		hid_timer_arm(struct hid_timer *, int);
+void		hid_timer_disarm(struct hid_timer *);
+uint32_t	hid_timer_ms(void);
+uint64_t	hid_timer_ms64(void);
+int		hid_watch_add(struct hid_watch *, int, void (*)(void *),
+		    void *);
+void		hid_watch_del(struct hid_watch *);
 int		hid_match_devid(struct hid_interface *, struct uhidd_devid *,
 		    int);
 int		hid_match_interface(struct hid_interface *, int, int, int);
@@ -473,15 +671,24 @@ int		kbd_match(struct hid_appcol *);
 int		kbd_attach(struct hid_appcol *);
 int		kbd_hid2key(struct hid_appcol *, struct hid_key, int,
     struct hid_scancode *, int);
-void		kbd_input(struct hid_appcol *, uint8_t, struct hid_key *, int);
+void		kbd_input_bitmap(struct hid_appcol *, uint8_t, uint16_t,
+		    uint32_t *, int);
+void		kbd_input_pages(struct hid_appcol *, uint8_t, uint32_t *,
+		    uint32_t *, int);
+void		kbd_input_tap(struct hid_appcol *, struct hid_key, int);
 void		kbd_recv(struct hid_appcol *, struct hid_report *);
 void		kbd_set_tr(struct hid_appcol *, hid_translator);
+int		kbd_flush(struct hid_appcol *);
+void		kbd_stats(struct hid_appcol *, FILE *);
 int		mouse_match(struct hid_appcol *);
 int		mouse_attach(struct hid_appcol *);
 void		mouse_recv(struct hid_appcol *, struct hid_report *);
+int		mouse_flush(struct hid_appcol *);
 struct device_config *config_find_device(int, int, int);
 int		config_mouse_attach(struct hid_interface *);
 int		config_kbd_attach(struct hid_interface *);
+int		config_kbd_debounce(struct hid_interface *);
+int		config_kbd_merge(struct hid_interface *);
 int		config_vhid_attach(struct hid_interface *);
 int		config_cc_attach(struct hid_interface *);
 void		config_init(void);
@@ -495,15 +702,24 @@ void		run_hidaction(struct hid_appcol *, struct hid_report *);
 int		ucuse_init(void);
 int		ucuse_create_worker(void);
 int		ucuse_copy_out_string(const char *, void *, int);
+void		ucuse_poll_wakeup(void);
 const char	*usage_page(int);
 const char	*usage_in_page(int, int);
+int		usage_consumer_lookup(const char *);
 int		vhid_match(struct hid_appcol *);
 int		vhid_attach(struct hid_appcol *);
 void		vhid_recv_raw(struct hid_appcol *, uint8_t *, int);
+int		vhid_flush(struct hid_appcol *);
 struct evdev_dev *evdev_register_device(void *, struct evdev_cb *);
-void		evdev_report_key_event(struct evdev_dev *, int, int, int);
-void		evdev_report_key_repeat_event(struct evdev_dev *, int);
-void		evdev_sync_report(struct evdev_dev *);
+void		evdev_frame_key(struct evdev_dev *, int, int, int);
+void		evdev_frame_key_repeat(struct evdev_dev *, int);
+void		evdev_frame_commit(struct evdev_dev *);
+void		evdev_frame_tap(struct evdev_dev *, int, int, int);
+void		evdev_frame_stamp(struct evdev_dev *, struct timespec *);
+void		evdev_stats(struct evdev_dev *, FILE *, const char *);
+void		evdev_add_appcol(struct evdev_dev *, struct hid_appcol *);
+void		evdev_hold(struct evdev_dev *);
+int		evdev_flush(struct evdev_dev *);
 const char	*evdev_devname(struct evdev_dev *);
 int		evdev_hid2key(struct hid_key *);
 int		microsoft_match(struct hid_interface *);
@@ -36,10 +36,13 @@ __FBSDID("$FreeBSD$");
 #include <dev/usb/usbhid.h>
 #include <assert.h>
 #include <libgen.h>
+#include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
+#include <unistd.h>
 #include "uhidd.h"
 
 static uint8_t free_key[] =
@@ -61,34 +64,249 @@ static uint8_t free_key[] =
 
 #define	_FREE_KEY_COUNT	((int)(sizeof(free_key)/sizeof(free_key[0])))
 
+static void	cc_keymap_changed(struct hid_interface *hi);
+
+/*
+ * The keys assigned to the free keys (the in-memory keymap) are saved
+ * off the input path by cc_keymap_task(), which batches the changes
+ * of CC_KEYMAP_DELAY seconds. They're written both to the cc_keymap
+ * file of the runtime directory, in the format of uhidd.conf, and to
+ * CC_KEYMAP_SAVE, from which the next uhidd attaching to the same
+ * interface reloads them, so that the keys keep their keycodes.
+ * cc_keymap_sync() writes them out at once on detach and on exit.
+ */
+#define	CC_KEYMAP_SAVE		"/var/run/uhidd.cc_keymap.%04x.%04x.%d"
+#define	CC_KEYMAP_DELAY		1
+
+struct cc_keymap_hdr {
+	char		ck_magic[8];
+	uint32_t	ck_version;
+	uint32_t	ck_nkey;
+	int32_t		ck_free_key_pos;
+};
+
+#define	CC_KEYMAP_MAGIC		"UHIDDCCK"
+#define	CC_KEYMAP_VERSION	1
+
+static STAILQ_HEAD(, hid_interface) cc_keymap_dirtyq =
+    STAILQ_HEAD_INITIALIZER(cc_keymap_dirtyq);
+static pthread_mutex_t cc_keymap_mtx = PTHREAD_MUTEX_INITIALIZER;
+/* Serializes the writers, so an older keymap never replaces a newer. */
+static pthread_mutex_t cc_keymap_io_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cc_keymap_cv = PTHREAD_COND_INITIALIZER;
+static pthread_once_t cc_keymap_once = PTHREAD_ONCE_INIT;
+
 static void
-cc_write_keymap_file(struct hid_interface *hi)
+cc_write_keymap_file(struct hid_interface *hi, uint8_t *keymap)
 {
-	char fpath[256];
+	char fpath[256], tpath[PATH_MAX];
 	FILE *fp;
 	int i;
 
 	snprintf(fpath, sizeof(fpath), "/var/run/uhidd.%s/cc_keymap",
 	    hi->dev);
-	fp = fopen(fpath, "w+");
+	snprintf(tpath, sizeof(tpath), "%s.tmp", fpath);
+	fp = fopen(tpath, "w");
 	if (fp == NULL) {
 		syslog(LOG_ERR, "%s[%d] fopen %s failed: %m",
-		    hi->dev, hi->ndx, fpath);
+		    hi->dev, hi->ndx, tpath);
 		return;
 	}
 	fprintf(fp, "0x%04x:0x%04x={\n", hi->vendor_id, hi->product_id);
 	fprintf(fp, "\tcc_keymap={\n");
 	for (i = 0; i < usage_consumer_num && i < _MAX_MM_KEY; i++) {
-		if (hi->cc_keymap[i]) {
+		if (keymap[i]) {
 			if (!strcasecmp(usage_consumer[i], "Reserved"))
 				fprintf(fp, "\t\t0x%X=", (unsigned) i);
 			else
 				fprintf(fp, "\t\t%s=", usage_consumer[i]);
-			fprintf(fp, "\"0x%02X\"\n", hi->cc_keymap[i]);
+			fprintf(fp, "\"0x%02X\"\n", keymap[i]);
 		}
 	}
 	fprintf(fp, "\t}\n}\n");
 	fclose(fp);
+	if (rename(tpath, fpath) < 0) {
+		syslog(LOG_ERR, "%s[%d] rename %s failed: %m", hi->dev,
+		    hi->ndx, tpath);
+		unlink(tpath);
+	}
+}
+
+static void
+cc_save_keymap(struct hid_interface *hi, uint8_t *keymap, int pos)
+{
+	struct cc_keymap_hdr h;
+	char path[PATH_MAX], tpath[PATH_MAX];
+	FILE *fp;
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.ck_magic, CC_KEYMAP_MAGIC, sizeof(h.ck_magic));
+	h.ck_version = CC_KEYMAP_VERSION;
+	h.ck_nkey = _MAX_MM_KEY;
+	h.ck_free_key_pos = pos;
+
+	/* Replace the file atomically. */
+	snprintf(path, sizeof(path), CC_KEYMAP_SAVE, hi->vendor_id,
+	    hi->product_id, hi->ndx);
+	snprintf(tpath, sizeof(tpath), "%s.%d", path, getpid());
+	if ((fp = fopen(tpath, "w")) == NULL)
+		return;
+	if (fwrite(&h, sizeof(h), 1, fp) != 1 ||
+	    fwrite(keymap, _MAX_MM_KEY, 1, fp) != 1) {
+		fclose(fp);
+		unlink(tpath);
+		return;
+	}
+	fclose(fp);
+	if (rename(tpath, path) < 0)
+		unlink(tpath);
+}
+
+/*
+ * Reload the in-memory keymap saved by a previous uhidd. The keycodes
+ * are checked against the free keys, in case the list changed.
+ */
+static void
+cc_load_keymap(struct hid_interface *hi)
+{
+	struct cc_keymap_hdr h;
+	uint8_t keymap[_MAX_MM_KEY];
+	char path[PATH_MAX];
+	FILE *fp;
+	int cnt, i, j, ok;
+
+	snprintf(path, sizeof(path), CC_KEYMAP_SAVE, hi->vendor_id,
+	    hi->product_id, hi->ndx);
+	if ((fp = fopen(path, "r")) == NULL)
+		return;
+	ok = fread(&h, sizeof(h), 1, fp) == 1 &&
+	    memcmp(h.ck_magic, CC_KEYMAP_MAGIC, sizeof(h.ck_magic)) == 0 &&
+	    h.ck_version == CC_KEYMAP_VERSION && h.ck_nkey == _MAX_MM_KEY &&
+	    h.ck_free_key_pos >= 0 && h.ck_free_key_pos <= _FREE_KEY_COUNT &&
+	    fread(keymap, sizeof(keymap), 1, fp) == 1;
+	fclose(fp);
+	if (!ok)
+		return;
+
+	for (i = cnt = 0; i < _MAX_MM_KEY; i++) {
+		if (keymap[i] == 0)
+			continue;
+		for (j = 0; j < h.ck_free_key_pos; j++)
+			if (free_key[j] == keymap[i])
+				break;
+		if (j == h.ck_free_key_pos)
+			return;
+		cnt++;
+	}
+
+	pthread_mutex_lock(&cc_keymap_mtx);
+	memcpy(hi->cc_keymap, keymap, sizeof(hi->cc_keymap));
+	hi->free_key_pos = h.ck_free_key_pos;
+	if (cnt > 0)
+		cc_keymap_changed(hi);
+	pthread_mutex_unlock(&cc_keymap_mtx);
+	PRINT1(1, "reloaded %d remembered hid key maps\n", cnt);
+}
+
+/*
+ * Queue the in-memory keymap of hi for saving. Called with
+ * cc_keymap_mtx held.
+ */
+static void
+cc_keymap_changed(struct hid_interface *hi)
+{
+
+	if (hi->cc_keymap_dirty)
+		return;
+	hi->cc_keymap_dirty = 1;
+	STAILQ_INSERT_TAIL(&cc_keymap_dirtyq, hi, cc_keymap_next);
+	pthread_cond_signal(&cc_keymap_cv);
+}
+
+/*
+ * Write out the pending keymap of the interface (of all of them if
+ * NULL) now, e.g. on detach, instead of waiting for cc_keymap_task().
+ */
+void
+cc_keymap_sync(struct hid_interface *only)
+{
+	struct hid_interface *hi;
+	uint8_t keymap[_MAX_MM_KEY];
+	int pos;
+
+	pthread_mutex_lock(&cc_keymap_io_mtx);
+	pthread_mutex_lock(&cc_keymap_mtx);
+	for (;;) {
+		STAILQ_FOREACH(hi, &cc_keymap_dirtyq, cc_keymap_next)
+			if (only == NULL || hi == only)
+				break;
+		if (hi == NULL)
+			break;
+		STAILQ_REMOVE(&cc_keymap_dirtyq, hi, hid_interface,
+		    cc_keymap_next);
+		hi->cc_keymap_dirty = 0;
+		memcpy(keymap, hi->cc_keymap, sizeof(keymap));
+		pos = hi->free_key_pos;
+		pthread_mutex_unlock(&cc_keymap_mtx);
+		cc_write_keymap_file(hi, keymap);
+		cc_save_keymap(hi, keymap, pos);
+		pthread_mutex_lock(&cc_keymap_mtx);
+	}
+	pthread_mutex_unlock(&cc_keymap_mtx);
+	pthread_mutex_unlock(&cc_keymap_io_mtx);
+}
+
+/* ARGSUSED */
+static void *
+cc_keymap_task(void *arg __unused)
+{
+
+	pthread_mutex_lock(&cc_keymap_mtx);
+	for (;;) {
+		while (STAILQ_EMPTY(&cc_keymap_dirtyq))
+			pthread_cond_wait(&cc_keymap_cv, &cc_keymap_mtx);
+
+		/* Let the keys of a burst of new keys pile up. */
+		pthread_mutex_unlock(&cc_keymap_mtx);
+		sleep(CC_KEYMAP_DELAY);
+		cc_keymap_sync(NULL);
+		pthread_mutex_lock(&cc_keymap_mtx);
+	}
+
+	return (NULL);
+}
+
+static void
+cc_keymap_init(void)
+{
+	pthread_t thread;
+
+	if (pthread_create(&thread, NULL, cc_keymap_task, NULL) != 0)
+		syslog(LOG_ERR, "pthread_create failed: %m");
+}
+
+/*
+ * Resolve the effective keymap of the interface: the keymap of the
+ * device in uhidd.conf, else the global one, else the keys remembered
+ * so far (and the free keys assigned later on, see cc_tr()).
+ */
+static void
+cc_resolve_keymap(struct hid_interface *hi)
+{
+	struct device_config *dconfig;
+
+	dconfig = config_find_device(hi->vendor_id, hi->product_id, hi->ndx);
+	if (dconfig != NULL && dconfig->cc_keymap_set) {
+		memcpy(hi->cc_map, dconfig->cc_keymap, sizeof(hi->cc_map));
+		hi->cc_map_user = 1;
+	} else if (uconfig.gconfig.cc_keymap_set) {
+		memcpy(hi->cc_map, uconfig.gconfig.cc_keymap,
+		    sizeof(hi->cc_map));
+		hi->cc_map_user = 1;
+	} else {
+		memcpy(hi->cc_map, hi->cc_keymap, sizeof(hi->cc_map));
+		hi->cc_map_user = 0;
+	}
 }
 
 static int
@@ -96,7 +314,6 @@ cc_tr(struct hid_appcol *ha, struct hid_key hk, int make,
     struct hid_scancode *c, int len)
 {
 	struct hid_interface *hi;
-	struct device_config *dconfig;
 
 	assert(c != NULL && len > 0);
 
@@ -110,45 +327,30 @@ cc_tr(struct hid_appcol *ha, struct hid_key hk, int make,
 	if (hk.up == HUP_KEYBOARD)
 		return (kbd_hid2key(ha, hk, make, c, len));
 
-	if (hk.up != HUP_CONSUMER)
+	if (hk.up != HUP_CONSUMER || hk.code >= _MAX_MM_KEY)
 		return (0);
 
 	(*c).make = make;
 
-	/*
-	 * Check if there is a user provided keymap.
-	 */
-	dconfig = config_find_device(hi->vendor_id, hi->product_id, hi->ndx);
-	if (dconfig != NULL && dconfig->cc_keymap_set) {
-		if (dconfig->cc_keymap[hk.code] != 0) {
-			(*c).sc = dconfig->cc_keymap[hk.code];
-			return (1);
-		} else
-			return (0);
-	}
-	if (uconfig.gconfig.cc_keymap_set) {
-		if (uconfig.gconfig.cc_keymap[hk.code] != 0) {
-			(*c).sc = uconfig.gconfig.cc_keymap[hk.code];
-			return (1);
-		} else
-			return (0);
-	}
-
-	/*
-	 * Check if there is a key translation in the in-memory keymap.
-	 */
-	if (hi->cc_keymap[hk.code] != 0) {
-		(*c).sc = hi->cc_keymap[hk.code];
+	if (hi->cc_map[hk.code] != 0) {
+		(*c).sc = hi->cc_map[hk.code];
 		return (1);
 	}
 
+	/* A user provided keymap is authoritative. */
+	if (hi->cc_map_user)
+		return (0);
+
 	/*
 	 * Try allocating a free key for this "HID key".
 	 */
 	if (hi->free_key_pos < _FREE_KEY_COUNT) {
+		pthread_mutex_lock(&cc_keymap_mtx);
 		hi->cc_keymap[hk.code] = free_key[hi->free_key_pos];
+		hi->cc_map[hk.code] = hi->cc_keymap[hk.code];
 		hi->free_key_pos++;
-		cc_write_keymap_file(hi);
+		cc_keymap_changed(hi);
+		pthread_mutex_unlock(&cc_keymap_mtx);
 		PRINT1(1, "remembered new hid key map: 0x%x => 0x%02x\n",
 		    hk.code, hi->cc_keymap[hk.code]);
 		(*c).sc = hi->cc_keymap[hk.code];
@@ -201,28 +403,30 @@ cc_attach(struct hid_appcol *ha)
 
 	if (kbd_attach(ha) < 0)
 		return (-1);
+	pthread_once(&cc_keymap_once, cc_keymap_init);
+	if (hi->free_key_pos == 0)
+		cc_load_keymap(hi);
+	cc_resolve_keymap(hi);
 	kbd_set_tr(ha, cc_tr);
 
 	return (0);
 }
 
-#define MAX_KEYCODE 256
+#define	CC_NWORD	(_MAX_MM_KEY / 32)
 
 static void
-cc_process_volume_usage(struct hid_appcol *ha, struct hid_report *hr, int value)
+cc_process_volume_usage(struct hid_appcol *ha, int value)
 {
 	struct hid_interface *hi;
-	struct hid_field *hf;
-	int i, flags, total;
-	struct hid_key keycodes[MAX_KEYCODE];
-	uint16_t key;
+	struct hid_key hk;
 
 	/*
 	 * HUG_VOLUME has Usage Type LC (linear control). Usually it has
 	 * value range [-Min, Max]. Positive value n increments the volume
 	 * by n. Negative value -n decrements the volumn by n. To fit in
 	 * our key press/release model, HUG_VOLUME is simulated by
-	 * pressing/releasing HUG_VOLUME_UP or HUG_VLOLUME_DOWN n times.
+	 * pressing/releasing HUG_VOLUME_UP or HUG_VLOLUME_DOWN n times,
+	 * all in one go.
 	 */
 
 	hi = hid_appcol_get_parser_private(ha);
@@ -232,85 +436,64 @@ cc_process_volume_usage(struct hid_appcol *ha, struct hid_report *hr, int value)
 	if (value == 0)
 		return;
 
-	/* The keyboard driver needs to know the total number of keys. */
-	total = 0;
-	hf = NULL;
-	while ((hf = hid_report_get_next_field(hr, hf, HID_INPUT)) != NULL) {
-		flags = hid_field_get_flags(hf);
-		if (flags & HIO_CONST)
-			continue;
-		for (i = 0; i < hf->hf_count; i++)
-			total++;
-	}
-	if (total >= MAX_KEYCODE)
-		return;
-
+	hk.up = HUP_CONSUMER;
 	if (value < 0)
-		key = HUG_VOLUME_DOWN;
+		hk.code = HUG_VOLUME_DOWN;
 	else
-		key = HUG_VOLUME_UP;
-	value = abs(value);
-
-	memset(keycodes, 0, sizeof(keycodes));
-	for (i = 0; i < value; i++) {
-		/* Key press. */
-		keycodes[0].code = key;
-		keycodes[0].up = HUP_CONSUMER;
-		kbd_input(ha, 0, keycodes, total);
-		PRINT1(1, "hid codes: 0x%02X (HUG_VOLUME)\n",
-		    keycodes[0].code);
-		/* Key release. */
-		keycodes[0].code = 0;
-		kbd_input(ha, 0, keycodes, total);
-		PRINT1(2, "hid codes: none (HUG_VOLUME)\n");
-	}
+		hk.code = HUG_VOLUME_UP;
+	kbd_input_tap(ha, hk, abs(value));
+	PRINT1(1, "hid codes: 0x%02X x %d (HUG_VOLUME)\n", hk.code,
+	    abs(value));
 }
 
 static void
-cc_process_key(struct hid_appcol *ha, struct hid_report *hr, unsigned usage,
-    int value, int *total, int *cnt, struct hid_key *keycodes)
+cc_process_key(struct hid_appcol *ha, unsigned usage, int value,
+    uint32_t keys[][CC_NWORD])
 {
+	unsigned code;
+	int p;
 
 	/* Skip the keys this driver can't handle. */
-	if (HID_PAGE(usage) != HUP_CONSUMER && HID_PAGE(usage) != HUP_KEYBOARD)
-		return;
-
-	/* "total" counts all keys, pressed and released. */
-	if (*total >= MAX_KEYCODE)
+	switch (HID_PAGE(usage)) {
+	case HUP_KEYBOARD:
+		p = 0;
+		break;
+	case HUP_CONSUMER:
+		p = 1;
+		break;
+	default:
 		return;
-	(*total)++;
+	}
 
-	if (HID_PAGE(usage) == HUP_CONSUMER &&
-	    HID_USAGE(usage) == HUG_VOLUME && value) {
-		cc_process_volume_usage(ha, hr, value);
+	code = HID_USAGE(usage);
+	if (p == 1 && code == HUG_VOLUME && value) {
+		cc_process_volume_usage(ha, value);
 		return;
 	}
 
-	if (value) {
-		/* "cnt" counts pressed keys. */
-		if (*cnt >= MAX_KEYCODE)
-			return;
-		keycodes[*cnt].code = HID_USAGE(usage);
-		keycodes[*cnt].up = HID_PAGE(usage);
-		(*cnt)++;
-	}
+	if (value && code < _MAX_MM_KEY)
+		keys[p][code / 32] |= 1U << (code % 32);
 }
 
+/*
+ * The keys pressed are collected in a bitmap of the keyboard page and
+ * one of the consumer page, whatever the width of the usage arrays of
+ * the report. The keyboard driver only visits the words which changed
+ * since the previous report.
+ */
 void
 cc_recv(struct hid_appcol *ha, struct hid_report *hr)
 {
 	struct hid_interface *hi;
 	struct hid_field *hf;
-	struct hid_key keycodes[MAX_KEYCODE];
-	unsigned usage, rusage[8];
-	int i, j, value, cnt, flags, total, r, len;
+	uint32_t keys[2][CC_NWORD];
+	unsigned code, usage, rusage[8];
+	int i, j, p, value, flags, r, len;
 
 	hi = hid_appcol_get_parser_private(ha);
 	assert(hi != NULL);
 
-	total = 0;
-	cnt = 0;
-	memset(keycodes, 0, sizeof(keycodes));
+	memset(keys, 0, sizeof(keys));
 
 	hf = NULL;
 	while ((hf = hid_report_get_next_field(hr, hf, HID_INPUT)) != NULL) {
@@ -330,27 +513,39 @@ cc_recv(struct hid_appcol *ha, struct hid_report *hr)
 				if (r == HID_FILTER_REPLACE) {
 					assert(len > 0);
 					for (j = 0; j < len; j++)
-						cc_process_key(ha, hr,
-						    rusage[j], 1, &total,
-						    &cnt, keycodes);
+						cc_process_key(ha, rusage[j],
+						    1, keys);
 					continue;
 				}
 			}
 
-			cc_process_key(ha, hr, usage, value, &total, &cnt,
-			    keycodes);
+			cc_process_key(ha, usage, value, keys);
 		}
 	}
 
-	if (total > 0 && verbose > 1) {
+	if (verbose > 1) {
 		PRINT1(2, "hid codes: ");
-		if (cnt == 0)
+		for (p = j = 0; p < 2; p++) {
+			for (code = 1; code < _MAX_MM_KEY; code++) {
+				if ((keys[p][code / 32] & (1U << (code % 32)))
+				    == 0)
+					continue;
+				printf("0x%02X(0x%02X) ", code,
+				    p ? HUP_CONSUMER : HUP_KEYBOARD);
+				j++;
+			}
+		}
+		if (j == 0)
 			printf("none");
-		for (i = 0; i < cnt; i++)
-			printf("0x%02X(0x%02X) ", keycodes[i].code,
-			    keycodes[i].up);
 		putchar('\n');
 	}
 
-	kbd_input(ha, 0, keycodes, total);
+	kbd_input_pages(ha, 0, keys[0], keys[1], _MAX_MM_KEY);
+}
+
+int
+cc_flush(struct hid_appcol *ha)
+{
+
+	return (kbd_flush(ha));
 }
@@ -44,6 +44,9 @@ __FBSDID("$FreeBSD$");
 #include "uhidd.h"
 
 static int cuse4bsd_init = 0;
+static pthread_mutex_t cuse4bsd_init_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static int	ucuse_init_locked(void);
 
 #if 0
 const char *uhidd_cusedevs[] = {
@@ -56,8 +59,24 @@ const char *uhidd_cusedevs[] = {
 };
 #endif
 
+/*
+ * Interfaces are attached from their own threads, serialize the
+ * initialization so the kernel module is loaded only once.
+ */
 int
 ucuse_init(void)
+{
+	int ret;
+
+	pthread_mutex_lock(&cuse4bsd_init_mtx);
+	ret = ucuse_init_locked();
+	pthread_mutex_unlock(&cuse4bsd_init_mtx);
+
+	return (ret);
+}
+
+static int
+ucuse_init_locked(void)
 {
 	int cuse4bsd_load, status;
 
@@ -139,6 +158,13 @@ ucuse_create_worker(void)
 	return (0);
 }
 
+void
+ucuse_poll_wakeup(void)
+{
+
+	cuse_poll_wakeup();
+}
+
 int
 ucuse_copy_out_string(const char *src, void *peer, int len)
 {
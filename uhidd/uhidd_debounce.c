@@ -0,0 +1,99 @@
+/*-
+ * Copyright (c) 2015 Kai Wang
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Switch chatter filter. A transition of a key is accepted only if the
+ * previous accepted transition of that key is at least db_window ms
+ * old. The timestamps are 64-bit, so a key idle for any length of time
+ * is always outside its window.
+ */
+
+#include <sys/cdefs.h>
+__FBSDID("$FreeBSD$");
+
+#include <sys/param.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "uhidd.h"
+
+int
+hid_debounce_init(struct hid_debounce *db, int window, int nkey)
+{
+
+	db->db_window = window;
+	db->db_last = calloc(nkey, sizeof(*db->db_last));
+	db->db_cnt = calloc(nkey, sizeof(*db->db_cnt));
+	if (db->db_last == NULL || db->db_cnt == NULL) {
+		free(db->db_last);
+		free(db->db_cnt);
+		db->db_last = NULL;
+		db->db_cnt = NULL;
+		return (-1);
+	}
+	db->db_now = 0;
+	db->db_next = 0;
+	db->db_pending = 0;
+
+	return (0);
+}
+
+/*
+ * Start a pass over the keys at time now; the pending deadline is
+ * recomputed by the hid_debounce_key() calls of the pass.
+ */
+void
+hid_debounce_begin(struct hid_debounce *db, uint64_t now)
+{
+
+	db->db_now = now;
+	db->db_pending = 0;
+}
+
+/*
+ * Returns 1 if the transition of key ndx must be suppressed; db_next is
+ * then the earliest time the pass must be repeated. A key never seen
+ * before has db_last 0 and is accepted.
+ */
+int
+hid_debounce_key(struct hid_debounce *db, int ndx, int counted)
+{
+	uint64_t end;
+
+	end = db->db_last[ndx] + db->db_window;
+	if (db->db_last[ndx] == 0 || end <= db->db_now) {
+		db->db_last[ndx] = db->db_now;
+		return (0);
+	}
+
+	if (counted)
+		db->db_cnt[ndx]++;
+	if (!db->db_pending || end < db->db_next)
+		db->db_next = end;
+	db->db_pending = 1;
+
+	return (1);
+}
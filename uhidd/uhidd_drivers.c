@@ -38,6 +38,8 @@ struct hid_appcol_driver hid_appcol_driver_list[] = {
 		kbd_attach,
 		kbd_recv,
 		NULL,
+		kbd_flush,
+		kbd_stats,
 	},
 
 	/* General Mouse Driver. */
@@ -47,6 +49,8 @@ struct hid_appcol_driver hid_appcol_driver_list[] = {
 		mouse_attach,
 		mouse_recv,
 		NULL,
+		mouse_flush,
+		NULL,
 	},
 
 	/* Virtual HID Driver. */
@@ -56,6 +60,8 @@ struct hid_appcol_driver hid_appcol_driver_list[] = {
 		vhid_attach,
 		NULL,
 		vhid_recv_raw,
+		vhid_flush,
+		NULL,
 	},
 
 	/* General Consumer Control Driver. */
@@ -65,6 +71,8 @@ struct hid_appcol_driver hid_appcol_driver_list[] = {
 		cc_attach,
 		cc_recv,
 		NULL,
+		cc_flush,
+		kbd_stats,
 	}
 };
 
@@ -81,3 +89,13 @@ struct hid_interface_driver hid_interface_driver_list[] = {
 
 const int hid_interface_driver_num = sizeof(hid_interface_driver_list) /
     sizeof(hid_interface_driver_list[0]);
+
+struct hid_transport *hid_transport_list[] = {
+	/* Capture file replay, only matches when --replay is given. */
+	&replay_transport,
+	/* libusb20 transport. */
+	&libusb20_transport,
+};
+
+const int hid_transport_num = sizeof(hid_transport_list) /
+    sizeof(hid_transport_list[0]);
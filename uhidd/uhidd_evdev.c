@@ -136,7 +136,16 @@ struct evmsg {
 };
 
 #define	EVMSG_SZ	sizeof(struct evmsg)
-#define	EVBUF_SZ	(32 * EVMSG_SZ)
+#define	EVFRAME_NMSG	32
+/*
+ * The ring of a client holds a frame for each report of a dispatch
+ * batch, as they're delivered at once when the device is held (see
+ * evdev_hold()).
+ */
+#define	EVBUF_NMSG	(_XFER_BATCH_MAX * EVFRAME_NMSG)
+#define	EVBUF_SZ	(EVBUF_NMSG * EVMSG_SZ)
+/* Taps of evdev_frame_tap() held before the clients are woken. */
+#define	EVTAP_CHUNK	8
 #define	LONG_NBITS	(sizeof(unsigned long) * 8)
 #define NLONGS(x)	(howmany(x, LONG_NBITS))
 #define	NBYTES(x)	(howmany(x, LONG_NBITS) * sizeof(unsigned long))
@@ -177,10 +186,20 @@ struct evmsg {
 
 struct evdev_dev;
 
+/*
+ * Arrival of the report of a frame stamped with evdev_frame_stamp(),
+ * kept aside the SYN_REPORT of the frame for the read latency.
+ */
+struct evstamp {
+	struct timespec ts;
+	int valid;
+};
+
 /* evdev client struct */
 struct evclient {
 	struct evdev_dev *evdev;
 	char buf[EVBUF_SZ];
+	struct evstamp stamp[EVBUF_NMSG];	/* One per message of buf. */
 	char *head;
 	char *tail;
 	size_t cc;
@@ -218,6 +237,17 @@ struct evdev_dev {
 	unsigned long led_states[NLONGS(LED_CNT)];
 	unsigned long switch_states[NLONGS(SWITCH_CNT)];
 	unsigned long sound_states[NLONGS(SOUND_CNT)];
+	struct evmsg frame[EVFRAME_NMSG];
+	int framecnt;
+	struct timeval frame_tv;
+	struct timespec frame_arrival;
+	int frame_stamped;
+	struct hid_lathist lat_read;
+	char pend[EVBUF_SZ];
+	struct evstamp pend_stamp[EVBUF_NMSG];
+	size_t pendcc;
+	unsigned char held;
+	unsigned char pendout;
 	int refcnt;
 	unsigned totalcnt;
 	pthread_mutex_t ed_mtx;
@@ -229,16 +259,25 @@ struct evdev_dev {
 #define	EVDEV_UNLOCK(s)		pthread_mutex_unlock(&(s)->ed_mtx)
 };
 
-static void evclient_enqueue(struct evclient *ec, char *buf, size_t len);
-static int evclient_dequeue(struct evclient *ec, char *buf, size_t len);
+static void evclient_enqueue(struct evclient *ec, char *buf,
+    struct evstamp *st, size_t len);
+static int evclient_dequeue(struct evclient *ec, char *buf,
+    struct evstamp *st, size_t len);
 static struct evdev_dev *evdev_alloc(void *priv, struct evdev_cb *cb);
 static int evdev_alloc_cuse_dev(struct evdev_dev *ed);
 static void evdev_init_bits(struct evdev_dev *ed);
+static void evdev_init_appcol_bits(struct evdev_dev *ed,
+    struct hid_appcol *ha);
 static void evdev_init_input_bits(struct evdev_dev *ed, struct hid_field *hf);
 static void evdev_init_output_bits(struct evdev_dev *ed, struct hid_field *hf);
 static void evdev_grab(struct evdev_dev *ed, struct evclient *ec,
     uint32_t grab);
-static void evdev_enqueue(struct evdev_dev *ed, char *buf, size_t len);
+static void evdev_enqueue(struct evdev_dev *ed, char *buf, size_t len,
+    struct timespec *arrival);
+static void evdev_deliver(struct evdev_dev *ed);
+static int evdev_wakeup(struct evdev_dev *ed);
+static void evdev_read_latency(struct evdev_dev *ed, char *buf,
+    struct evstamp *st, int len);
 static int evdev_cuse_open(struct cuse_dev *cdev, int fflags);
 static int evdev_cuse_close(struct cuse_dev *cdev, int fflags);
 static int evdev_cuse_read(struct cuse_dev *cdev, int fflags, void *peer_ptr,
@@ -278,48 +317,166 @@ evdev_register_device(void *priv, struct evdev_cb *cb)
 	return (ed);
 }
 
+/*
+ * Add the keys and LEDs of another appcol to the device, for a device
+ * which serves several appcols.
+ */
+void
+evdev_add_appcol(struct evdev_dev *ed, struct hid_appcol *ha)
+{
+
+	evdev_init_appcol_bits(ed, ha);
+}
+
+/*
+ * Frame builder. The events generated for one report are accumulated
+ * in the frame of the device, then committed to the clients with a
+ * single enqueue terminated by one SYN_REPORT. All the events of a
+ * frame share the same timestamp. A report is only split over several
+ * frames if it has more than EVFRAME_NMSG events. The frame belongs to
+ * the driver of the device, which serializes the calls.
+ */
 void
-evdev_report_key_event(struct evdev_dev *ed, int scancode, int key,
-    int value)
+evdev_frame_key(struct evdev_dev *ed, int scancode, int key, int value)
 {
-	struct evmsg em[2];
 	struct timeval tv;
 
-	if (gettimeofday(&tv, NULL) < 0)
-		return;
+	/* Full, leave room for the SYN_REPORT. */
+	if (ed->framecnt + 2 >= EVFRAME_NMSG)
+		evdev_frame_commit(ed);
+	if (ed->framecnt == 0 && !ed->frame_stamped)
+		gettimeofday(&ed->frame_tv, NULL);
+	tv = ed->frame_tv;
 
-	EVMSG(em[0], EVTYPE_MISC, 4, scancode);
-	EVMSG(em[1], EVTYPE_KEY, key, value);
+	EVMSG(ed->frame[ed->framecnt], EVTYPE_MISC, 4, scancode);
+	EVMSG(ed->frame[ed->framecnt + 1], EVTYPE_KEY, key, value);
+	ed->framecnt += 2;
+}
+
+void
+evdev_frame_key_repeat(struct evdev_dev *ed, int key)
+{
+	struct timeval tv;
+
+	if (ed->framecnt + 1 >= EVFRAME_NMSG)
+		evdev_frame_commit(ed);
+	if (ed->framecnt == 0 && !ed->frame_stamped)
+		gettimeofday(&ed->frame_tv, NULL);
+	tv = ed->frame_tv;
 
-	evdev_enqueue(ed, (char *) em, sizeof(em));
+	EVMSG(ed->frame[ed->framecnt], EVTYPE_KEY, key, 2);
+	ed->framecnt++;
 }
 
 void
-evdev_report_key_repeat_event(struct evdev_dev *ed, int key)
+evdev_frame_commit(struct evdev_dev *ed)
 {
-	struct evmsg em;
 	struct timeval tv;
+	int stamped;
 
-	if (gettimeofday(&tv, NULL) < 0)
+	stamped = ed->frame_stamped;
+	ed->frame_stamped = 0;
+	if (ed->framecnt == 0)
 		return;
 
-	EVMSG(em, EVTYPE_KEY, key, 2);
+	tv = ed->frame_tv;
+	EVMSG(ed->frame[ed->framecnt], EVTYPE_SYN, 0, 1);
+	ed->framecnt++;
 
-	evdev_enqueue(ed, (char *) &em, sizeof(em));
+	evdev_enqueue(ed, (char *) ed->frame, ed->framecnt * EVMSG_SZ,
+	    stamped ? &ed->frame_arrival : NULL);
+	ed->framecnt = 0;
 }
 
+/*
+ * Press and release key n times, each press and each release in a
+ * frame of its own. While the device is held, the taps are delivered
+ * and the clients woken every EVTAP_CHUNK taps, so that a large delta
+ * (a knob spun fast) is read as it comes rather than overrunning the
+ * ring of a client at evdev_flush().
+ */
 void
-evdev_sync_report(struct evdev_dev *ed)
+evdev_frame_tap(struct evdev_dev *ed, int scancode, int key, int n)
+{
+	int i, wakeup;
+
+	for (i = 0; i < n; i++) {
+		evdev_frame_key(ed, scancode, key, 1);
+		evdev_frame_commit(ed);
+		evdev_frame_key(ed, scancode, key, 0);
+		evdev_frame_commit(ed);
+		if ((i + 1) % EVTAP_CHUNK != 0 || i + 1 == n)
+			continue;
+		wakeup = 0;
+		EVDEV_LOCK(ed);
+		if (ed->held && ed->pendcc > 0) {
+			evdev_deliver(ed);
+			wakeup = evdev_wakeup(ed);
+		}
+		EVDEV_UNLOCK(ed);
+		if (wakeup)
+			cuse_poll_wakeup();
+	}
+}
+
+/*
+ * Time stamp the next frame with the arrival time of its report (on the
+ * monotonic clock), instead of the time it is built.
+ */
+void
+evdev_frame_stamp(struct evdev_dev *ed, struct timespec *arrival)
 {
-	struct evmsg em;
-	struct timeval tv;
 
-	if (gettimeofday(&tv, NULL) < 0)
+	if (ed->framecnt > 0)
 		return;
-	
-	EVMSG(em, EVTYPE_SYN, 0, 1);
+	hid_stats_realtime(arrival, &ed->frame_tv);
+	ed->frame_arrival = *arrival;
+	ed->frame_stamped = 1;
+}
+
+/*
+ * Histogram of the time from the arrival of a report until a client
+ * reads the SYN_REPORT of its frame. Only the frames stamped with
+ * evdev_frame_stamp() are counted; those written by clients or built
+ * by the key repeat are not.
+ */
+void
+evdev_stats(struct evdev_dev *ed, FILE *fp, const char *name)
+{
+
+	hid_lathist_dump(&ed->lat_read, fp, name);
+}
+
+/*
+ * Hold the event messages of the device until evdev_flush() is called,
+ * so that a burst of reports costs one wakeup of the clients.
+ */
+void
+evdev_hold(struct evdev_dev *ed)
+{
+
+	EVDEV_LOCK(ed);
+	ed->held = 1;
+	EVDEV_UNLOCK(ed);
+}
+
+/*
+ * Deliver the held event messages and wakeup all clients. Returns
+ * non-zero if the caller should call cuse_poll_wakeup().
+ */
+int
+evdev_flush(struct evdev_dev *ed)
+{
+	int wakeup;
+
+	EVDEV_LOCK(ed);
+	if (ed->pendcc > 0)
+		evdev_deliver(ed);
+	wakeup = evdev_wakeup(ed);
+	ed->held = 0;
+	EVDEV_UNLOCK(ed);
 
-	evdev_enqueue(ed, (char *) &em, sizeof(em));
+	return (wakeup);
 }
 
 const char *
@@ -384,10 +541,6 @@ static void
 evdev_init_bits(struct evdev_dev *ed)
 {
 	struct hid_interface *hi = ed->cb->get_hid_interface(ed->priv);
-	struct hid_appcol *ha = ed->cb->get_hid_appcol(ed->priv);
-	struct hid_report *hr;
-	struct hid_field *hf;
-	int flags, i;
 
 	BIT_SET(ed->evtype_bits, EVTYPE_SYN);
 	PRINT1(2, "set EVTYPE_SYN\n");
@@ -398,6 +551,16 @@ evdev_init_bits(struct evdev_dev *ed)
 		ed->repeat_bits[0] = 0x3;
 	}
 
+	evdev_init_appcol_bits(ed, ed->cb->get_hid_appcol(ed->priv));
+}
+
+static void
+evdev_init_appcol_bits(struct evdev_dev *ed, struct hid_appcol *ha)
+{
+	struct hid_report *hr;
+	struct hid_field *hf;
+	int flags, i;
+
 	STAILQ_FOREACH(hr, &ha->ha_hrlist, hr_next) {
 		for (i = 0; i < 3; i++) {
 			if (STAILQ_EMPTY(&hr->hr_hflist[i]))
@@ -536,19 +699,62 @@ evdev_grab(struct evdev_dev *ed, struct evclient *ec, uint32_t grab)
 		cuse_poll_wakeup();
 }
 
+/*
+ * Enqueue event messages to the clients. If arrival is not NULL, the
+ * last message is the SYN_REPORT of a frame stamped with that arrival.
+ */
 static void
-evdev_enqueue(struct evdev_dev *ed, char *buf, size_t len)
+evdev_enqueue(struct evdev_dev *ed, char *buf, size_t len,
+    struct timespec *arrival)
 {
 	struct evclient *ec;
+	struct evstamp st[EVFRAME_NMSG], *stp;
+	int i, n, wakeup;
 
 	assert(ed != NULL && buf != NULL);
 	assert(len > 0 && len % EVMSG_SZ == 0 && len <= EVBUF_SZ);
 
-	/* Insert the event message and wakeup all clients. */
+	n = len / EVMSG_SZ;
 	EVDEV_LOCK(ed);
+	if (ed->held) {
+		/*
+		 * Out of room, deliver what is held so far and wakeup the
+		 * clients now rather than at evdev_flush(), so that they
+		 * can read it before the rest of the burst arrives.
+		 */
+		if (len > EVBUF_SZ - ed->pendcc) {
+			evdev_deliver(ed);
+			wakeup = evdev_wakeup(ed);
+		} else
+			wakeup = 0;
+		memcpy(ed->pend + ed->pendcc, buf, len);
+		stp = &ed->pend_stamp[ed->pendcc / EVMSG_SZ];
+		for (i = 0; i < n; i++)
+			stp[i].valid = 0;
+		if (arrival != NULL) {
+			stp[n - 1].ts = *arrival;
+			stp[n - 1].valid = 1;
+		}
+		ed->pendcc += len;
+		EVDEV_UNLOCK(ed);
+		if (wakeup)
+			cuse_poll_wakeup();
+		return;
+	}
+
+	stp = NULL;
+	if (arrival != NULL) {
+		for (i = 0; i < n - 1; i++)
+			st[i].valid = 0;
+		st[n - 1].ts = *arrival;
+		st[n - 1].valid = 1;
+		stp = st;
+	}
+
+	/* Insert the event message and wakeup all clients. */
 	LIST_FOREACH(ec, &ed->clients, next) {
 		EVCLIENT_LOCK(ec);
-		evclient_enqueue(ec, buf, len);
+		evclient_enqueue(ec, buf, stp, len);
 		pthread_cond_signal(&ec->cv);
 		EVCLIENT_UNLOCK(ec);
 	}
@@ -557,11 +763,57 @@ evdev_enqueue(struct evdev_dev *ed, char *buf, size_t len)
 	cuse_poll_wakeup();
 }
 
+/*
+ * Move the held event messages to the clients, without waking them up.
+ * Called with the device lock held.
+ */
 static void
-evclient_enqueue(struct evclient *ec, char *buf, size_t len)
+evdev_deliver(struct evdev_dev *ed)
+{
+	struct evclient *ec;
+
+	LIST_FOREACH(ec, &ed->clients, next) {
+		EVCLIENT_LOCK(ec);
+		evclient_enqueue(ec, ed->pend, ed->pend_stamp, ed->pendcc);
+		EVCLIENT_UNLOCK(ec);
+	}
+	ed->pendcc = 0;
+	ed->pendout = 1;
+}
+
+/*
+ * Wakeup the clients if messages were delivered to them since the last
+ * wakeup. Returns non-zero if cuse_poll_wakeup() should be called.
+ * Called with the device lock held.
+ */
+static int
+evdev_wakeup(struct evdev_dev *ed)
+{
+	struct evclient *ec;
+
+	if (!ed->pendout)
+		return (0);
+	LIST_FOREACH(ec, &ed->clients, next) {
+		EVCLIENT_LOCK(ec);
+		pthread_cond_signal(&ec->cv);
+		EVCLIENT_UNLOCK(ec);
+	}
+	ed->pendout = 0;
+
+	return (1);
+}
+
+/*
+ * Copy len bytes of event messages to the ring of the client; st, if
+ * not NULL, holds the stamps of the messages.
+ */
+static void
+evclient_enqueue(struct evclient *ec, char *buf, struct evstamp *st,
+    size_t len)
 {
 	struct evmsg *em;
 	size_t part1, part2;
+	int i, n, pos;
 
 	assert(ec != NULL && buf != NULL);
 	assert(len > 0 && len % EVMSG_SZ == 0 && len <= EVBUF_SZ);
@@ -573,7 +825,7 @@ evclient_enqueue(struct evclient *ec, char *buf, size_t len)
 	 * SYN_DROPPED event.
 	 */
 	if (len > EVBUF_SZ - ec->cc) {
-		evclient_dequeue(ec, NULL, len - (EVBUF_SZ - ec->cc));
+		evclient_dequeue(ec, NULL, NULL, len - (EVBUF_SZ - ec->cc));
 		/*
 		 * Signal buffer overrun. (but don't do anything if the
 		 * ring buffer is already empty)
@@ -586,6 +838,16 @@ evclient_enqueue(struct evclient *ec, char *buf, size_t len)
 		}
 	}
 
+	/* The ring only ever holds whole messages. */
+	n = len / EVMSG_SZ;
+	pos = (ec->tail - ec->buf) / EVMSG_SZ;
+	for (i = 0; i < n; i++) {
+		if (st != NULL)
+			ec->stamp[(pos + i) % EVBUF_NMSG] = st[i];
+		else
+			ec->stamp[(pos + i) % EVBUF_NMSG].valid = 0;
+	}
+
 	part1 = EVBUF_SZ - (ec->tail - ec->buf);
 	if (part1 > len)
 		part1 = len;
@@ -608,10 +870,16 @@ evclient_enqueue(struct evclient *ec, char *buf, size_t len)
 	}
 }
 
+/*
+ * Take up to len bytes of event messages from the ring of the client;
+ * the stamps of the messages are copied to st if not NULL.
+ */
 static int
-evclient_dequeue(struct evclient *ec, char *buf, size_t len)
+evclient_dequeue(struct evclient *ec, char *buf, struct evstamp *st,
+    size_t len)
 {
 	size_t part1, part2;
+	int i, pos;
 
 	assert(ec != NULL && ec->cc > 0);
 	assert(len > 0 && len % EVMSG_SZ == 0);
@@ -619,6 +887,12 @@ evclient_dequeue(struct evclient *ec, char *buf, size_t len)
 	if (len > ec->cc)
 		len = ec->cc;
 
+	if (st != NULL) {
+		pos = (ec->head - ec->buf) / EVMSG_SZ;
+		for (i = 0; i < (int) (len / EVMSG_SZ); i++)
+			st[i] = ec->stamp[(pos + i) % EVBUF_NMSG];
+	}
+
 	part1 = EVBUF_SZ - (ec->head - ec->buf);
 	if (part1 > len)
 		part1 = len;
@@ -700,11 +974,28 @@ evdev_cuse_close(struct cuse_dev *cdev, int fflags)
 	return (CUSE_ERR_NONE);
 }
 
+static void
+evdev_read_latency(struct evdev_dev *ed, char *buf, struct evstamp *st,
+    int len)
+{
+	struct evmsg *em;
+	int i;
+
+	for (i = 0; i < len / (int) EVMSG_SZ; i++) {
+		em = (struct evmsg *)(uintptr_t)(buf + i * EVMSG_SZ);
+		if (em->type != EVTYPE_SYN || em->code != 0 || !st[i].valid)
+			continue;
+		hid_lathist_add(&ed->lat_read, &st[i].ts);
+	}
+}
+
 static int
 evdev_cuse_read(struct cuse_dev *cdev, int fflags, void *peer_ptr, int len)
 {
+	struct evdev_dev *ed = cuse_dev_get_priv0(cdev);
 	struct evclient *ec = cuse_dev_get_per_file_handle(cdev);
-	char buf[EVMSG_SZ * EVBUF_SZ];
+	char buf[EVBUF_SZ];
+	struct evstamp st[EVBUF_NMSG];
 	int err;
 
 	if (len == 0 || len % EVMSG_SZ != 0) {
@@ -720,9 +1011,10 @@ evdev_cuse_read(struct cuse_dev *cdev, int fflags, void *peer_ptr, int len)
 
 read_again:
 	if (ec->cc > 0) {
-		len = evclient_dequeue(ec, buf, len);
+		len = evclient_dequeue(ec, buf, st, len);
 		assert(len > 0 && len % EVMSG_SZ == 0);
 		EVCLIENT_UNLOCK(ec);
+		evdev_read_latency(ed, buf, st, len);
 		err = cuse_copy_out(buf, peer_ptr, len);
 		EVCLIENT_LOCK(ec);
 	} else {
@@ -753,7 +1045,7 @@ evdev_cuse_write(struct cuse_dev *cdev, int fflags, const void *peer_ptr,
 {
 	struct evdev_dev *ed = cuse_dev_get_priv0(cdev);
 	struct evclient *ec = cuse_dev_get_per_file_handle(cdev);
-	char buf[EVMSG_SZ * EVBUF_SZ];
+	char buf[EVBUF_SZ];
 	int err;
 
 	(void) fflags;
@@ -778,7 +1070,7 @@ evdev_cuse_write(struct cuse_dev *cdev, int fflags, const void *peer_ptr,
 	if (err != CUSE_ERR_NONE)
 		goto write_done;
 
-	evclient_enqueue(ec, buf, len);
+	evclient_enqueue(ec, buf, NULL, len);
 
 write_done:
 	ec->flags &= ~EVCLIENT_WRITE;
@@ -787,7 +1079,7 @@ write_done:
 	if (err)
 		return (err);
 
-	evdev_enqueue(ed, buf, len);
+	evdev_enqueue(ed, buf, len, NULL);
 
 	return (len);
 }
@@ -275,381 +275,117 @@ static const int k[] =
 };
 
 /*
- * Translation table for HUP_CONSUMER usages to evdev key codes.
+ * Translation table for HUP_CONSUMER usages to evdev key codes, usages
+ * not listed here have no translation.
  */
-static int
-evdev_consumer2key(uint16_t u)
+static const uint16_t c[0x29D] =
 {
-
-	switch(u) {
-	case 0x000: /* Unassigned                           */ return -1;
-	case 0x001: /* Consumer Control                     */ return -1;
-	case 0x002: /* Numeric Key Pad                      */ return -1;
-	case 0x003: /* Programmable Buttons                 */ return -1;
-	case 0x004: /* Microphone                           */ return -1;
-	case 0x005: /* Headphone                            */ return -1;
-	case 0x006: /* Graphic Equalizer                    */ return -1;
-	case 0x020: /* +10                                  */ return -1;
-	case 0x021: /* +100                                 */ return -1;
-	case 0x022: /* AM/PM                                */ return -1;
-	case 0x030: /* Power                                */ return -1;
-	case 0x031: /* Reset                                */ return -1;
-	case 0x032: /* Sleep                                */ return -1;
-	case 0x033: /* Sleep After                          */ return -1;
-	case 0x034: /* Sleep Mode                           */ return -1;
-	case 0x035: /* Illumination                         */ return -1;
-	case 0x036: /* Function Buttons                     */ return -1;
-	case 0x040: /* Menu                                 */ return 0x8B;
-	case 0x041: /* Menu Pick                            */ return -1;
-	case 0x042: /* Menu Up                              */ return -1;
-	case 0x043: /* Menu Down                            */ return -1;
-	case 0x044: /* Menu Left                            */ return -1;
-	case 0x045: /* Menu Right                           */ return -1;
-	case 0x046: /* Menu Escape                          */ return -1;
-	case 0x047: /* Menu Value Increase                  */ return -1;
-	case 0x048: /* Menu Value Decrease                  */ return -1;
-	case 0x060: /* Data On Screen                       */ return -1;
-	case 0x061: /* Closed Caption                       */ return -1;
-	case 0x062: /* Closed Caption Select                */ return -1;
-	case 0x063: /* VCR/TV                               */ return -1;
-	case 0x064: /* Broadcast Mode                       */ return -1;
-	case 0x065: /* Snapshot                             */ return -1;
-	case 0x066: /* Still                                */ return -1;
-	case 0x080: /* Selection                            */ return -1;
-	case 0x081: /* Assign Selection                     */ return -1;
-	case 0x082: /* Mode Step                            */ return -1;
-	case 0x083: /* Recall Last                          */ return 0x195;
-	case 0x084: /* Enter Channel                        */ return -1;
-	case 0x085: /* Order Movie                          */ return -1;
-	case 0x086: /* Channel                              */ return 0x16B;
-	case 0x087: /* Media Selection                      */ return -1;
-	case 0x088: /* Media Select Computer                */ return 0x178;
-	case 0x089: /* Media Select TV                      */ return 0x179;
-	case 0x08A: /* Media Select WWW                     */ return -1;
-	case 0x08B: /* Media Select DVD                     */ return 0x185;
-	case 0x08C: /* Media Select Telephone               */ return 0xA9;
-	case 0x08D: /* Media Select Program Guide           */ return 0x16A;
-	case 0x08E: /* Media Select Video Phone             */ return 0x1A0;
-	case 0x08F: /* Media Select Games                   */ return 0x1A1;
-	case 0x090: /* Media Select Messages                */ return 0x18C;
-	case 0x091: /* Media Select CD                      */ return 0x17F;
-	case 0x092: /* Media Select VCR                     */ return 0x17B;
-	case 0x093: /* Media Select Tuner                   */ return 0x182;
-	case 0x094: /* Quit                                 */ return -1;
-	case 0x095: /* Help                                 */ return 0x8A;
-	case 0x096: /* Media Select Tape                    */ return 0x180;
-	case 0x097: /* Media Select Cable                   */ return 0x17A;
-	case 0x098: /* Media Select Satellite               */ return 0x17D;
-	case 0x099: /* Media Select Security                */ return -1;
-	case 0x09A: /* Media Select Home                    */ return 0x16E;
-	case 0x09B: /* Media Select Call                    */ return -1;
-	case 0x09C: /* Channel Increment                    */ return 0x192;
-	case 0x09D: /* Channel Decrement                    */ return 0x193;
-	case 0x09E: /* Media Select SAP                     */ return -1;
-	case 0x0A0: /* VCR Plus                             */ return 0x17C;
-	case 0x0A1: /* Once                                 */ return -1;
-	case 0x0A2: /* Daily                                */ return -1;
-	case 0x0A3: /* Weekly                               */ return -1;
-	case 0x0A4: /* Monthly                              */ return -1;
-	case 0x0B0: /* Play                                 */ return 0xC8;
-	case 0x0B1: /* Pause                                */ return 0xC9;
-	case 0x0B2: /* Record                               */ return 0xA7;
-	case 0x0B3: /* Fast Forward                         */ return 0xD0;
-	case 0x0B4: /* Rewind                               */ return 0xA8;
-	case 0x0B5: /* Scan Next Track                      */ return 0xA3;
-	case 0x0B6: /* Scan Previous Track                  */ return 0xA5;
-	case 0x0B7: /* Stop                                 */ return 0xA6;
-	case 0x0B8: /* Eject                                */ return 0xA1;
-	case 0x0B9: /* Random Play                          */ return -1;
-	case 0x0BA: /* Select DisC                          */ return -1;
-	case 0x0BB: /* Enter Disc                           */ return -1;
-	case 0x0BC: /* Repeat                               */ return -1;
-	case 0x0BD: /* Tracking                             */ return -1;
-	case 0x0BE: /* Track Normal                         */ return -1;
-	case 0x0BF: /* Slow Tracking                        */ return -1;
-	case 0x0C0: /* Frame Forward                        */ return -1;
-	case 0x0C1: /* Frame Back                           */ return -1;
-	case 0x0C2: /* Mark                                 */ return -1;
-	case 0x0C3: /* Clear Mark                           */ return -1;
-	case 0x0C4: /* Repeat From Mark                     */ return -1;
-	case 0x0C5: /* Return To Mark                       */ return -1;
-	case 0x0C6: /* Search Mark Forward                  */ return -1;
-	case 0x0C7: /* Search Mark Backwards                */ return -1;
-	case 0x0C8: /* Counter Reset                        */ return -1;
-	case 0x0C9: /* Show Counter                         */ return -1;
-	case 0x0CA: /* Tracking Increment                   */ return -1;
-	case 0x0CB: /* Tracking Decrement                   */ return -1;
-	case 0x0CC: /* Stop/Eject                           */ return -1;
-	case 0x0CD: /* Play/Pause                           */ return 0xA4;
-	case 0x0CE: /* Play/Skip                            */ return -1;
-	case 0x0E0: /* Volume                               */ return -1;
-	case 0x0E1: /* Balance                              */ return -1;
-	case 0x0E2: /* Mute                                 */ return 0x71;
-	case 0x0E3: /* Bass                                 */ return -1;
-	case 0x0E4: /* Treble                               */ return -1;
-	case 0x0E5: /* Bass Boost                           */ return 0xD1;
-	case 0x0E6: /* Surround Mode                        */ return -1;
-	case 0x0E7: /* Loudness                             */ return -1;
-	case 0x0E8: /* MPX                                  */ return -1;
-	case 0x0E9: /* Volume Increment                     */ return 0x73;
-	case 0x0EA: /* Volume Decrement                     */ return 0x72;
-	case 0x0F0: /* Speed Select                         */ return -1;
-	case 0x0F1: /* Playback Speed                       */ return -1;
-	case 0x0F2: /* Standard Play                        */ return -1;
-	case 0x0F3: /* Long Play                            */ return -1;
-	case 0x0F4: /* Extended Play                        */ return -1;
-	case 0x0F5: /* Slow                                 */ return -1;
-	case 0x100: /* Fan Enable                           */ return -1;
-	case 0x101: /* Fan Speed                            */ return -1;
-	case 0x102: /* Light Enable                         */ return -1;
-	case 0x103: /* Light Illumination Level             */ return -1;
-	case 0x104: /* Climate Control Enable               */ return -1;
-	case 0x105: /* Room Temperature                     */ return -1;
-	case 0x106: /* Security Enable                      */ return -1;
-	case 0x107: /* Fire Alarm                           */ return -1;
-	case 0x108: /* Police Alarm                         */ return -1;
-	case 0x109: /* Proximity                            */ return -1;
-	case 0x10A: /* Motion                               */ return -1;
-	case 0x10B: /* Duress Alarm                         */ return -1;
-	case 0x10C: /* Holdup Alarm                         */ return -1;
-	case 0x10D: /* Medical Alarm                        */ return -1;
-	case 0x150: /* Balance Right                        */ return -1;
-	case 0x151: /* Balance Left                         */ return -1;
-	case 0x152: /* Bass Increment                       */ return -1;
-	case 0x153: /* Bass Decrement                       */ return -1;
-	case 0x154: /* Treble Increment                     */ return -1;
-	case 0x155: /* Treble Decrement                     */ return -1;
-	case 0x160: /* Speaker System                       */ return -1;
-	case 0x161: /* Channel Left                         */ return -1;
-	case 0x162: /* Channel Right                        */ return -1;
-	case 0x163: /* Channel Center                       */ return -1;
-	case 0x164: /* Channel Front                        */ return -1;
-	case 0x165: /* Channel Center Front                 */ return -1;
-	case 0x166: /* Channel Side                         */ return -1;
-	case 0x167: /* Channel Surround                     */ return -1;
-	case 0x168: /* Channel Low Frequency Enhancement    */ return -1;
-	case 0x169: /* Channel Top                          */ return -1;
-	case 0x16A: /* Channel Unknown                      */ return -1;
-	case 0x170: /* Sub-channel                          */ return -1;
-	case 0x171: /* Sub-channel Increment                */ return -1;
-	case 0x172: /* Sub-channel Decrement                */ return -1;
-	case 0x173: /* Alternate Audio Increment            */ return -1;
-	case 0x174: /* Alternate Audio Decrement            */ return -1;
-	case 0x180: /* Application Launch Buttons           */ return -1;
-	case 0x181: /* AL Launch Button Configuration Tool  */ return 0x240;
-	case 0x182: /* AL Programmable Button Configuration */ return 0x240;
-	case 0x183: /* AL Consumer Control Configuration    */ return 0xAB;
-	case 0x184: /* AL Word Processor                    */ return 0x1A5;
-	case 0x185: /* AL Text Editor                       */ return 0x1A6;
-	case 0x186: /* AL Spreadsheet                       */ return 0x1A7;
-	case 0x187: /* AL Graphics Editor                   */ return 0x1A8;
-	case 0x188: /* AL Presentation App                  */ return 0x1A9;
-	case 0x189: /* AL Database App                      */ return 0x1AA;
-	case 0x18A: /* AL Email Reader                      */ return 0xD7;
-	case 0x18B: /* AL Newsreader                        */ return 0x1AB;
-	case 0x18C: /* AL Voicemail                         */ return 0x1AC;
-	case 0x18D: /* AL Contacts/Address Book             */ return 0x1AD;
-	case 0x18E: /* AL Calendar/Schedule                 */ return 0x18D;
-	case 0x18F: /* AL Task/Project Manager              */ return 0x241;
-	case 0x190: /* AL Log/Journal/Timecard              */ return 0x242;
-	case 0x191: /* AL Checkbook/Finance                 */ return 0xDB;
-	case 0x192: /* AL Calculator                        */ return 0x8C;
-	case 0x193: /* AL A/V Capture/Playback              */ return -1;
-	case 0x194: /* AL Local Machine Browser             */ return 0x90;
-	case 0x195: /* AL LAN/WAN Browser                   */ return -1;
-	case 0x196: /* AL Internet Browser                  */ return 0x96;
-	case 0x197: /* AL Remote Networking/ISP Connect     */ return 0xDA;
-	case 0x198: /* AL Network Conference                */ return -1;
-	case 0x199: /* AL Network Chat                      */ return 0xD8;
-	case 0x19A: /* AL Telephony/Dialer                  */ return -1;
-	case 0x19B: /* AL Logon                             */ return -1;
-	case 0x19C: /* AL Logoff                            */ return 0x1B1;
-	case 0x19D: /* AL Logon/Logoff                      */ return -1;
-	case 0x19E: /* AL Terminal Lock/Screensaver         */ return 0x98;
-	case 0x19F: /* AL Control Panel                     */ return 0x243;
-	case 0x1A0: /* AL Command Line Processor/Run        */ return -1;
-	case 0x1A1: /* AL Process/Task Manager              */ return -1;
-	case 0x1A2: /* AL Select Tast/Application           */ return 0x244;
-	case 0x1A3: /* AL Next Task/Application             */ return -1;
-	case 0x1A4: /* AL Previous Task/Application         */ return -1;
-	case 0x1A5: /* AL Preemptive Halt Task/Application  */ return -1;
-	case 0x1A6: /* AL Integrated Help Center            */ return 0x8A;
-	case 0x1A7: /* AL Documents                         */ return 0xEB;
-	case 0x1A8: /* AL Thesaurus                         */ return -1;
-	case 0x1A9: /* AL Dictionary                        */ return -1;
-	case 0x1AA: /* AL Desktop                           */ return -1;
-	case 0x1AB: /* AC Spell Check                       */ return 0x1B0;
-	case 0x1AC: /* AL Grammar Check                     */ return -1;
-	case 0x1AD: /* AL Wireless Status                   */ return -1;
-	case 0x1AE: /* AL Keyboard Layout                   */ return -1;
-	case 0x1AF: /* AL Virus Protection                  */ return -1;
-	case 0x1B0: /* AL Encryption                        */ return -1;
-	case 0x1B1: /* AL Screen Saver                      */ return 0x245;
-	case 0x1B2: /* AL Alarms                            */ return -1;
-	case 0x1B3: /* AL Clock                             */ return -1;
-	case 0x1B4: /* AL File Browser                      */ return -1;
-	case 0x1B5: /* AL Power Status                      */ return -1;
-	case 0x1B6: /* AL Image Browser                     */ return 0x1BA;
-	case 0x1B7: /* AL Audio Browser                     */ return 0x188;
-	case 0x1B8: /* AL Movie Browser                     */ return 0x189;
-	case 0x1B9: /* AL Digital Rights Manager            */ return -1;
-	case 0x1BA: /* AL Digital Wallet                    */ return -1;
-	case 0x1BC: /* AL Instant Messaging                 */ return 0x1AE;
-	case 0x1BD: /* AL OEM Feature/Tips/Tutorial Browser */ return 0x166;
-	case 0x1BE: /* AL OEM Help                          */ return -1;
-	case 0x1BF: /* AL Online Community                  */ return -1;
-	case 0x1C0: /* AL Entertainment Content Browser     */ return -1;
-	case 0x1C1: /* AL Online Shopping Browser           */ return -1;
-	case 0x1C2: /* AL SmartCard Information/Help        */ return -1;
-	case 0x1C3: /* AL Market Monitor/Finance Browser    */ return -1;
-	case 0x1C4: /* AL Customized Corporate News Browser */ return -1;
-	case 0x1C5: /* AL Online Activity Browser           */ return -1;
-	case 0x1C6: /* AL Research/Search Browser           */ return -1;
-	case 0x1C7: /* AL Audio Player                      */ return 0x183;
-	case 0x200: /* Generic GUI Application Controls     */ return -1;
-	case 0x201: /* AC New                               */ return 0xB5;
-	case 0x202: /* AC Open                              */ return 0x86;
-	case 0x203: /* AC Close                             */ return 0xCE;
-	case 0x204: /* AC Exit                              */ return 0xAE;
-	case 0x205: /* AC Maximize                          */ return -1;
-	case 0x206: /* AC Minimize                          */ return -1;
-	case 0x207: /* AC Save                              */ return 0xEA;
-	case 0x208: /* AC Print                             */ return 0xD2;
-	case 0x209: /* AC Properties                        */ return 0x82;
-	case 0x21A: /* AC Undo                              */ return 0x83;
-	case 0x21B: /* AC Copy                              */ return 0x85;
-	case 0x21C: /* AC Cut                               */ return 0x89;
-	case 0x21D: /* AC Paste                             */ return 0x87;
-	case 0x21E: /* AC Select All                        */ return -1;
-	case 0x21F: /* AC Find                              */ return 0x88;
-	case 0x220: /* AC Find and Replace                  */ return -1;
-	case 0x221: /* AC Search                            */ return 0x88;
-	case 0x222: /* AC Go To                             */ return -1;
-	case 0x223: /* AC Home                              */ return 0xAC;
-	case 0x224: /* AC Back                              */ return 0x9E;
-	case 0x225: /* AC Forward                           */ return 0x9F;
-	case 0x226: /* AC Stop                              */ return 0x80;
-	case 0x227: /* AC Refresh                           */ return 0xAD;
-	case 0x228: /* AC Previous Link                     */ return -1;
-	case 0x229: /* AC Next Link                         */ return -1;
-	case 0x22A: /* AC Bookmarks                         */ return 0x9C;
-	case 0x22B: /* AC History                           */ return -1;
-	case 0x22C: /* AC Subscriptions                     */ return -1;
-	case 0x22D: /* AC Zoom In                           */ return 0x1A2;
-	case 0x22E: /* AC Zoom Out                          */ return 0x1A3;
-	case 0x22F: /* AC Zoom                              */ return 0x1A4;
-	case 0x230: /* AC Full Screen View                  */ return -1;
-	case 0x231: /* AC Normal View                       */ return -1;
-	case 0x232: /* AC View Toggle                       */ return -1;
-	case 0x233: /* AC Scroll Up                         */ return 0xB1;
-	case 0x234: /* AC Scroll Down                       */ return 0xB2;
-	case 0x235: /* AC Scroll                            */ return -1;
-	case 0x236: /* AC Pan Left                          */ return -1;
-	case 0x237: /* AC Pan Right                         */ return -1;
-	case 0x238: /* AC Pan                               */ return -1;
-	case 0x239: /* AC New Window                        */ return -1;
-	case 0x23A: /* AC Tile Horizontally                 */ return -1;
-	case 0x23B: /* AC Tile Vertically                   */ return -1;
-	case 0x23C: /* AC Format                            */ return -1;
-	case 0x23D: /* AC Edit                              */ return 0xB0;
-	case 0x23E: /* AC Bold                              */ return -1;
-	case 0x23F: /* AC Italics                           */ return -1;
-	case 0x240: /* AC Underline                         */ return -1;
-	case 0x241: /* AC Strikethrough                     */ return -1;
-	case 0x242: /* AC Subscript                         */ return -1;
-	case 0x243: /* AC Superscript                       */ return -1;
-	case 0x244: /* AC All Caps                          */ return -1;
-	case 0x245: /* AC Rotate                            */ return -1;
-	case 0x246: /* AC Resize                            */ return -1;
-	case 0x247: /* AC Flip Horizontal                   */ return -1;
-	case 0x248: /* AC Flip Vertical                     */ return -1;
-	case 0x249: /* AC Mirror Horizontal                 */ return -1;
-	case 0x24A: /* AC Mirror Vertical                   */ return -1;
-	case 0x24B: /* AC Font Select                       */ return -1;
-	case 0x24C: /* AC Font Color                        */ return -1;
-	case 0x24D: /* AC Font Size                         */ return -1;
-	case 0x24E: /* AC Justify Left                      */ return -1;
-	case 0x24F: /* AC Justify Center H                  */ return -1;
-	case 0x250: /* AC Justify Right                     */ return -1;
-	case 0x251: /* AC Justify Block H                   */ return -1;
-	case 0x252: /* AC Justify Top                       */ return -1;
-	case 0x253: /* AC Justify Center V                  */ return -1;
-	case 0x254: /* AC Justify Bottom                    */ return -1;
-	case 0x255: /* AC Justify Block V                   */ return -1;
-	case 0x256: /* AC Justify Decrease                  */ return -1;
-	case 0x257: /* AC Justify Increase                  */ return -1;
-	case 0x258: /* AC Numbered List                     */ return -1;
-	case 0x259: /* AC Restart Numbering                 */ return -1;
-	case 0x25A: /* AC Bulleted List                     */ return -1;
-	case 0x25B: /* AC Promote                           */ return -1;
-	case 0x25C: /* AC Demote                            */ return -1;
-	case 0x25D: /* AC Yes                               */ return -1;
-	case 0x25E: /* AC No                                */ return -1;
-	case 0x25F: /* AC Cancel                            */ return 0xDF;
-	case 0x260: /* AC Catalog                           */ return -1;
-	case 0x261: /* AC Buy/Checkout                      */ return -1;
-	case 0x262: /* AC Add to Cart                       */ return -1;
-	case 0x263: /* AC Expand                            */ return -1;
-	case 0x264: /* AC Expand All                        */ return -1;
-	case 0x265: /* AC Collapse                          */ return -1;
-	case 0x266: /* AC Collapse All                      */ return -1;
-	case 0x267: /* AC Print Preview                     */ return -1;
-	case 0x268: /* AC Paste Special                     */ return -1;
-	case 0x269: /* AC Insert Mode                       */ return -1;
-	case 0x26A: /* AC Delete                            */ return -1;
-	case 0x26B: /* AC Lock                              */ return -1;
-	case 0x26C: /* AC Unlock                            */ return -1;
-	case 0x26D: /* AC Protect                           */ return -1;
-	case 0x26E: /* AC Unprotect                         */ return -1;
-	case 0x26F: /* AC Attach Comment                    */ return -1;
-	case 0x270: /* AC Delete Comment                    */ return -1;
-	case 0x271: /* AC View Comment                      */ return -1;
-	case 0x272: /* AC Select Word                       */ return -1;
-	case 0x273: /* AC Select Sentence                   */ return -1;
-	case 0x274: /* AC Select Paragraph                  */ return -1;
-	case 0x275: /* AC Select Column                     */ return -1;
-	case 0x276: /* AC Select Row                        */ return -1;
-	case 0x277: /* AC Select Table                      */ return -1;
-	case 0x278: /* AC Select Object                     */ return -1;
-	case 0x279: /* AC Redo/Repeat                       */ return 0xB6;
-	case 0x27A: /* AC Sort                              */ return -1;
-	case 0x27B: /* AC Sort Ascending                    */ return -1;
-	case 0x27C: /* AC Sort Descending                   */ return -1;
-	case 0x27D: /* AC Filter                            */ return -1;
-	case 0x27E: /* AC Set Clock                         */ return -1;
-	case 0x27F: /* AC View Clock                        */ return -1;
-	case 0x280: /* AC Select Time Zone                  */ return -1;
-	case 0x281: /* AC Edit Time Zones                   */ return -1;
-	case 0x282: /* AC Set Alarm                         */ return -1;
-	case 0x283: /* AC Clear Alarm                       */ return -1;
-	case 0x284: /* AC Snooze Alarm                      */ return -1;
-	case 0x285: /* AC Reset Alarm                       */ return -1;
-	case 0x286: /* AC Synchronize                       */ return -1;
-	case 0x287: /* AC Send/Receive                      */ return -1;
-	case 0x288: /* AC Send To                           */ return -1;
-	case 0x289: /* AC Reply                             */ return 0xE8;
-	case 0x28A: /* AC Reply All                         */ return -1;
-	case 0x28B: /* AC Forward Msg                       */ return 0xE9;
-	case 0x28C: /* AC Send                              */ return 0xE7;
-	case 0x28D: /* AC Attach File                       */ return -1;
-	case 0x28E: /* AC Upload                            */ return -1;
-	case 0x28F: /* AC Download (Save Target As)         */ return -1;
-	case 0x290: /* AC Set Borders                       */ return -1;
-	case 0x291: /* AC Insert Row                        */ return -1;
-	case 0x292: /* AC Insert Column                     */ return -1;
-	case 0x293: /* AC Insert File                       */ return -1;
-	case 0x294: /* AC Insert Picture                    */ return -1;
-	case 0x295: /* AC Insert Object                     */ return -1;
-	case 0x296: /* AC Insert Symbol                     */ return -1;
-	case 0x297: /* AC Save and Close                    */ return -1;
-	case 0x298: /* AC Rename                            */ return -1;
-	case 0x299: /* AC Merge                             */ return -1;
-	case 0x29A: /* AC Split                             */ return -1;
-	case 0x29B: /* AC Distribute Horizontally           */ return -1;
-	case 0x29C: /* AC Distribute Vertically             */ return -1;
-	default:    /* No Translation                       */ return -1;
-	}
-}
+/*==========================================*/
+/* Name                   HID code    evdev */
+/*==========================================*/
+/* Menu                         040 */ [0x040] = 0x8B,
+/* Recall Last                  083 */ [0x083] = 0x195,
+/* Channel                      086 */ [0x086] = 0x16B,
+/* Media Select Computer        088 */ [0x088] = 0x178,
+/* Media Select TV              089 */ [0x089] = 0x179,
+/* Media Select DVD             08B */ [0x08B] = 0x185,
+/* Media Select Telephone       08C */ [0x08C] = 0xA9,
+/* Media Select Program Guide   08D */ [0x08D] = 0x16A,
+/* Media Select Video Phone     08E */ [0x08E] = 0x1A0,
+/* Media Select Games           08F */ [0x08F] = 0x1A1,
+/* Media Select Messages        090 */ [0x090] = 0x18C,
+/* Media Select CD              091 */ [0x091] = 0x17F,
+/* Media Select VCR             092 */ [0x092] = 0x17B,
+/* Media Select Tuner           093 */ [0x093] = 0x182,
+/* Help                         095 */ [0x095] = 0x8A,
+/* Media Select Tape            096 */ [0x096] = 0x180,
+/* Media Select Cable           097 */ [0x097] = 0x17A,
+/* Media Select Satellite       098 */ [0x098] = 0x17D,
+/* Media Select Home            09A */ [0x09A] = 0x16E,
+/* Channel Increment            09C */ [0x09C] = 0x192,
+/* Channel Decrement            09D */ [0x09D] = 0x193,
+/* VCR Plus                     0A0 */ [0x0A0] = 0x17C,
+/* Play                         0B0 */ [0x0B0] = 0xC8,
+/* Pause                        0B1 */ [0x0B1] = 0xC9,
+/* Record                       0B2 */ [0x0B2] = 0xA7,
+/* Fast Forward                 0B3 */ [0x0B3] = 0xD0,
+/* Rewind                       0B4 */ [0x0B4] = 0xA8,
+/* Scan Next Track              0B5 */ [0x0B5] = 0xA3,
+/* Scan Previous Track          0B6 */ [0x0B6] = 0xA5,
+/* Stop                         0B7 */ [0x0B7] = 0xA6,
+/* Eject                        0B8 */ [0x0B8] = 0xA1,
+/* Play/Pause                   0CD */ [0x0CD] = 0xA4,
+/* Mute                         0E2 */ [0x0E2] = 0x71,
+/* Bass Boost                   0E5 */ [0x0E5] = 0xD1,
+/* Volume Increment             0E9 */ [0x0E9] = 0x73,
+/* Volume Decrement             0EA */ [0x0EA] = 0x72,
+/* AL Launch Button Configuration Tool 181 */ [0x181] = 0x240,
+/* AL Programmable Button Configuration 182 */ [0x182] = 0x240,
+/* AL Consumer Control Configuration 183 */ [0x183] = 0xAB,
+/* AL Word Processor            184 */ [0x184] = 0x1A5,
+/* AL Text Editor               185 */ [0x185] = 0x1A6,
+/* AL Spreadsheet               186 */ [0x186] = 0x1A7,
+/* AL Graphics Editor           187 */ [0x187] = 0x1A8,
+/* AL Presentation App          188 */ [0x188] = 0x1A9,
+/* AL Database App              189 */ [0x189] = 0x1AA,
+/* AL Email Reader              18A */ [0x18A] = 0xD7,
+/* AL Newsreader                18B */ [0x18B] = 0x1AB,
+/* AL Voicemail                 18C */ [0x18C] = 0x1AC,
+/* AL Contacts/Address Book     18D */ [0x18D] = 0x1AD,
+/* AL Calendar/Schedule         18E */ [0x18E] = 0x18D,
+/* AL Task/Project Manager      18F */ [0x18F] = 0x241,
+/* AL Log/Journal/Timecard      190 */ [0x190] = 0x242,
+/* AL Checkbook/Finance         191 */ [0x191] = 0xDB,
+/* AL Calculator                192 */ [0x192] = 0x8C,
+/* AL Local Machine Browser     194 */ [0x194] = 0x90,
+/* AL Internet Browser          196 */ [0x196] = 0x96,
+/* AL Remote Networking/ISP Connect 197 */ [0x197] = 0xDA,
+/* AL Network Chat              199 */ [0x199] = 0xD8,
+/* AL Logoff                    19C */ [0x19C] = 0x1B1,
+/* AL Terminal Lock/Screensaver 19E */ [0x19E] = 0x98,
+/* AL Control Panel             19F */ [0x19F] = 0x243,
+/* AL Select Tast/Application   1A2 */ [0x1A2] = 0x244,
+/* AL Integrated Help Center    1A6 */ [0x1A6] = 0x8A,
+/* AL Documents                 1A7 */ [0x1A7] = 0xEB,
+/* AC Spell Check               1AB */ [0x1AB] = 0x1B0,
+/* AL Screen Saver              1B1 */ [0x1B1] = 0x245,
+/* AL Image Browser             1B6 */ [0x1B6] = 0x1BA,
+/* AL Audio Browser             1B7 */ [0x1B7] = 0x188,
+/* AL Movie Browser             1B8 */ [0x1B8] = 0x189,
+/* AL Instant Messaging         1BC */ [0x1BC] = 0x1AE,
+/* AL OEM Feature/Tips/Tutorial Browser 1BD */ [0x1BD] = 0x166,
+/* AL Audio Player              1C7 */ [0x1C7] = 0x183,
+/* AC New                       201 */ [0x201] = 0xB5,
+/* AC Open                      202 */ [0x202] = 0x86,
+/* AC Close                     203 */ [0x203] = 0xCE,
+/* AC Exit                      204 */ [0x204] = 0xAE,
+/* AC Save                      207 */ [0x207] = 0xEA,
+/* AC Print                     208 */ [0x208] = 0xD2,
+/* AC Properties                209 */ [0x209] = 0x82,
+/* AC Undo                      21A */ [0x21A] = 0x83,
+/* AC Copy                      21B */ [0x21B] = 0x85,
+/* AC Cut                       21C */ [0x21C] = 0x89,
+/* AC Paste                     21D */ [0x21D] = 0x87,
+/* AC Find                      21F */ [0x21F] = 0x88,
+/* AC Search                    221 */ [0x221] = 0x88,
+/* AC Home                      223 */ [0x223] = 0xAC,
+/* AC Back                      224 */ [0x224] = 0x9E,
+/* AC Forward                   225 */ [0x225] = 0x9F,
+/* AC Stop                      226 */ [0x226] = 0x80,
+/* AC Refresh                   227 */ [0x227] = 0xAD,
+/* AC Bookmarks                 22A */ [0x22A] = 0x9C,
+/* AC Zoom In                   22D */ [0x22D] = 0x1A2,
+/* AC Zoom Out                  22E */ [0x22E] = 0x1A3,
+/* AC Zoom                      22F */ [0x22F] = 0x1A4,
+/* AC Scroll Up                 233 */ [0x233] = 0xB1,
+/* AC Scroll Down               234 */ [0x234] = 0xB2,
+/* AC Edit                      23D */ [0x23D] = 0xB0,
+/* AC Cancel                    25F */ [0x25F] = 0xDF,
+/* AC Redo/Repeat               279 */ [0x279] = 0xB6,
+/* AC Reply                     289 */ [0x289] = 0xE8,
+/* AC Forward Msg               28B */ [0x28B] = 0xE9,
+/* AC Send                      28C */ [0x28C] = 0xE7,
+};
 
 int
 evdev_hid2key(struct hid_key *hk)
@@ -662,8 +398,12 @@ evdev_hid2key(struct hid_key *hk)
 			return (-1);
 	}
 
-	if (hk->up == HUP_CONSUMER)
-		return (evdev_consumer2key(hk->code));
+	if (hk->up == HUP_CONSUMER) {
+		if (hk->code < nitems(c) && c[hk->code] != 0)
+			return (c[hk->code]);
+		else
+			return (-1);
+	}
 
 	return (-1);
 }
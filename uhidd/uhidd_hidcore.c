@@ -89,6 +89,37 @@ hid_parser_input_data(struct hid_parser *hp, char *data, int len)
 		printf("received data which doesn't belong to any appcol\n");
 }
 
+/*
+ * Called after all the reports received in one wakeup are passed to
+ * hid_parser_input_data(), to let the drivers push the output they
+ * have staged. Returns non-zero if cuse(3) pollers should be woken up.
+ */
+int
+hid_parser_flush(struct hid_parser *hp)
+{
+	struct hid_appcol *ha;
+	int wakeup;
+
+	wakeup = 0;
+	STAILQ_FOREACH(ha, &hp->halist, ha_next) {
+		if (ha->ha_drv != NULL && ha->ha_drv->ha_drv_flush != NULL)
+			wakeup |= ha->ha_drv->ha_drv_flush(ha);
+	}
+
+	return (wakeup);
+}
+
+void
+hid_parser_stats(struct hid_parser *hp, FILE *fp)
+{
+	struct hid_appcol *ha;
+
+	STAILQ_FOREACH(ha, &hp->halist, ha_next) {
+		if (ha->ha_drv != NULL && ha->ha_drv->ha_drv_stats != NULL)
+			ha->ha_drv->ha_drv_stats(ha, fp);
+	}
+}
+
 void
 hid_parser_output_data(struct hid_parser *hp, int report_id, char *data,
     int len)
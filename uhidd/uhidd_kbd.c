@@ -70,9 +70,12 @@ __FBSDID("$FreeBSD$");
 #include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <syslog.h>
 #include <unistd.h>
 
@@ -417,6 +420,25 @@ static struct {
 
 #define	MAX_KEYCODE	256
 
+/*
+ * Key state is kept as one bitmap per usage page: the keyboard page
+ * for kbd, plus the consumer page for cc.
+ */
+#define	KBD_PAGE_KEYBOARD	0
+#define	KBD_PAGE_CONSUMER	1
+#define	KBD_NPAGE		2
+#define	KBD_NCODE		1024
+#define	KBD_NWORD		(KBD_NCODE / 32)
+
+/*
+ * Per-keyboard translation tables, indexed by page and usage. A vkbd
+ * entry is either the scancode of the key, XLAT_NONE if the key is not
+ * mapped, or XLAT_SLOW if the translator must be called (keypad keys,
+ * whose scancodes depend on the modifiers, and keys not seen yet).
+ */
+#define	XLAT_NONE	0x0ffffffe
+#define	XLAT_SLOW	0x0fffffff
+
 struct kbd_data {
 	uint8_t mod;
 
@@ -429,8 +451,11 @@ struct kbd_data {
 #define	MOD_WIN_L	0x08
 #define	MOD_WIN_R	0x80
 
-	struct hid_key keycode[MAX_KEYCODE];
-	uint32_t time[MAX_KEYCODE];
+	uint32_t keys[KBD_NPAGE][KBD_NWORD];
+
+	/* Queued input only: tap key tap ntap times, see kbd_input_tap(). */
+	struct hid_key tap;
+	int ntap;
 };
 
 struct keypad_map {
@@ -439,34 +464,89 @@ struct keypad_map {
 	uint8_t state;
 };
 
+#define	VKBD_BUFSZ	256
+#define	KBD_NLEDRPT	4
+
+/*
+ * Input snapshots queued between the receive path and the output pass,
+ * see kbd_run(). A power of 2.
+ */
+#define	KBD_INQ		32
+
+#define	KBD_WORK_TIMER	0x1
+#define	KBD_WORK_FLUSH	0x2
+
+/*
+ * Keyboards which share one output device (kbd_merge); see
+ * kbd_merge_attach().
+ */
+#define	KBD_NMEMBER	16
+
+/*
+ * A kbd_dev has an input side (input queue, debounce and LED reports)
+ * and an output side (key state, repeat, translation, vkbd and evdev).
+ * kd->out is the kbd_dev whose output side serves kd: kd itself, unless
+ * the keyboards are merged, in which case it is a kbd_dev without an
+ * input side, the members of which are the merged keyboards.
+ */
 struct kbd_dev {
 	struct hid_appcol *ha;
+	struct kbd_dev *out;
+	struct kbd_dev *mbr[KBD_NMEMBER];	/* Members of the output. */
+	atomic_int nmbr;
 	int vkbd_fd;
-	int key_cnt;
+	int vkbd_buf[VKBD_BUFSZ];
+	int vkbd_cnt;
+	unsigned char held;
 	struct kbd_data ndata;
 	struct kbd_data odata;
-	pthread_t kbd_task;
-	pthread_t kbd_status_task;
-	pthread_mutex_t kbd_mtx;
+	struct kbd_data rdata;		/* Input before debounce. */
+	struct hid_debounce db;		/* Debounce window, or 0. */
+	struct hid_key rpt_key;		/* Last pressed key, which repeats. */
+	uint32_t rpt_time;
+	unsigned char rpt_held;
+	struct hid_timer repeat_timer;
+	struct hid_timer led_timer;
+	struct hid_watch status_watch;
+	unsigned char status_watched;
+	struct hid_report *led_hr[KBD_NLEDRPT];	/* Output reports w/ LEDs. */
+	int led_nhr;
+	int leds;			/* LED state last posted, or -1. */
+	atomic_int led_req;		/* LED state to send, or -1. */
+	int vkbd_leds;			/* LED state of the vkbd, or -1. */
+	struct kbd_data inq[KBD_INQ];
+	struct timespec inq_ts[KBD_INQ];	/* Arrival of the reports. */
+	atomic_uint inq_head;		/* Advanced by the output pass. */
+	atomic_uint inq_tail;		/* Advanced by the receive path. */
+	atomic_int work;		/* KBD_WORK_* for the output pass. */
+	atomic_int busy;		/* An output pass is running. */
+	int wakeup;
+	struct timespec in_ts;		/* Arrival of the input processed. */
+	unsigned char in_stamped;
+	struct timespec vkbd_ts;	/* Oldest arrival staged in vkbd_buf. */
+	unsigned char vkbd_stamped;
+	unsigned char ev_stamped;
+	struct hid_lathist lat_vkbd;
+	struct hid_lathist lat_evdev;
 	void *kbd_context;
 	void *evdev;
 	uint32_t now;
 	int delay1;
 	int delay2;
 	struct keypad_map kpm[kxsize];
+	int xlat_sc[KBD_NPAGE][KBD_NCODE];
+	int16_t xlat_ev[KBD_NPAGE][KBD_NCODE];
 	unsigned char use_vkbd;
 	unsigned char use_evdev;
-	/* Keycode translator. */
-	int (*kbd_tr)(struct hid_appcol *, struct hid_key, int,
-	    struct hid_scancode *, int);
+	/* Keycode translator of each page, and its appcol. */
+	hid_translator tr[KBD_NPAGE];
+	struct hid_appcol *tr_ha[KBD_NPAGE];
 
 #define KB_DELAY1	500
 #define KB_DELAY2	100
 };
 
 #define	KBD		hc->u.kd
-#define KBD_LOCK	pthread_mutex_lock(&kd->kbd_mtx);
-#define KBD_UNLOCK	pthread_mutex_unlock(&kd->kbd_mtx);
 
 struct kbd_mods {
 	uint32_t mask;
@@ -485,15 +565,42 @@ static struct kbd_mods kbd_mods[KBD_NMOD] = {
 	{.mask = MOD_WIN_R,	.key = {HUP_KEYBOARD, 0xe7}},
 };
 
-static void	*kbd_task(void *arg);
-static void	*kbd_status_task(void *arg);
+static pthread_mutex_t keymap_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+/* The output device of the merged keyboards. */
+static struct kbd_dev *kbd_merged;
+static pthread_mutex_t merge_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static int	kbd_out_init(struct kbd_dev *kd, enum attach_mode mode);
+static struct kbd_dev *kbd_merge_attach(struct kbd_dev *kd,
+		    enum attach_mode mode);
+static int	kbd_join(struct kbd_dev *out, struct kbd_dev *kd);
+static void	kbd_merge(struct kbd_dev *out);
+static int	kbd_pending(struct kbd_dev *out);
+static void	kbd_repeat(void *arg);
+static void	kbd_status(void *arg);
+static void	kbd_led_sync(void *arg);
+static void	kbd_send_leds(struct kbd_dev *kd, int leds);
+static void	kbd_find_leds(struct kbd_dev *kd);
 static void	kbd_write(struct kbd_dev *kd, struct hid_key hk, int make,
 		    int repeat);
 static void	kbd_write_vkbd(struct kbd_dev *kd, struct hid_key hk,
 		    int make);
+static void	kbd_vkbd_flush(struct kbd_dev *kd);
 static void	kbd_write_evdev(struct kbd_dev *kd, struct hid_key hk,
 		    int make, int repeat);
 static void	kbd_process_keys(struct kbd_dev *kd);
+static void	kbd_tap(struct kbd_dev *kd, struct hid_key hk, int n);
+static void	kbd_hold(struct kbd_dev *kd);
+static struct kbd_data *kbd_input_slot(struct kbd_dev *kd);
+static void	kbd_input_submit(struct kbd_dev *kd);
+static int	kbd_run(struct kbd_dev *kd, int work);
+static void	kbd_drain(struct kbd_dev *kd);
+static void	kbd_debounce(struct kbd_dev *kd, int fresh);
+static void	kbd_build_xlat(struct kbd_dev *kd);
+static int	kbd_keypad_key(struct hid_key hk);
+static int	kbd_page_index(uint16_t up);
+static struct hid_key kbd_bit2key(int page, int bit);
 static void	*kbd_get_hid_interface(void *priv);
 static void	*kbd_get_hid_appcol(void *priv);
 static void	kbd_get_repeat_delay(void *priv, int *delay1, int *delay2);
@@ -503,7 +610,12 @@ static int	keypad_hid2key(struct hid_appcol *ha, struct hid_key hk,
 static int	keypad_search_key(struct kbd_dev *kd, int sc, int state,
 		    char letter);
 static int	keypad_parse_keymap(struct kbd_dev *kd,
-		    const char *keymap_file);
+		    const char *keymap_file, struct stat *sb);
+static int	keypad_load_cache(struct kbd_dev *kd, const char *keymap_file,
+		    struct stat *sb);
+static void	keypad_save_cache(struct kbd_dev *kd, const char *keymap_file,
+		    struct stat *sb, int cnt);
+static int	keypad_rc_keymap(char *mapfile, size_t len);
 static void	keypad_init(struct kbd_dev *kd);
 
 /*
@@ -550,42 +662,76 @@ kbd_hid2key(struct hid_appcol *ha, struct hid_key hk, int make,
 	return (1);
 }
 
+/*
+ * Scancodes are staged in vkbd_buf and written to vkbd(4) once per
+ * kbd_process_keys() pass, or once per kbd_flush() while the output is
+ * held.
+ */
 static void
 kbd_write_vkbd(struct kbd_dev *kd, struct hid_key hk, int make)
 {
 	struct hid_scancode c[8];
-	int buf[32], *b, i, n, nk;
+	int *b, i, nk, p, sc;
 
-	assert(kd->kbd_tr != NULL);
-
-	nk = kd->kbd_tr(kd->ha, hk, make, c, sizeof(c) / sizeof(c[0]));
-
-	/* Ignore unmapped keys. */
-	if (nk == 0)
+	p = kbd_page_index(hk.up);
+	assert(p >= 0 && hk.code < KBD_NCODE);
+	assert(kd->tr[p] != NULL);
+	sc = kd->xlat_sc[p][hk.code];
+	if (sc == XLAT_NONE)
 		return;
+	if (sc != XLAT_SLOW) {
+		c[0].sc = sc;
+		c[0].make = make;
+		nk = 1;
+	} else {
+		nk = kd->tr[p](kd->tr_ha[p], hk, make, c,
+		    sizeof(c) / sizeof(c[0]));
+		/* Remember the translation, unless it's dynamic. */
+		if (nk <= 1 && !kbd_keypad_key(hk))
+			kd->xlat_sc[p][hk.code] = nk > 0 ? c[0].sc : XLAT_NONE;
+	}
 
-	n = 0;
-	b = buf;
 	for (i = 0; i < nk; i++) {
-		if ((size_t) n >= sizeof(buf) / sizeof(buf[0])) {
-			syslog(LOG_ERR,
-			    "Internal: not enough key input buffer,"
-			    " %d keys discarded", nk - i);
-			break;
-		}
-		if (c[i].make) {
-			if (c[i].sc & E0PREFIX)
-				PUT(0xe0, n, b);
-			PUT((c[i].sc & CODEMASK), n, b);
-		} else if (!(c[i].sc & NOBREAK)) {
-			if (c[i].sc & E0PREFIX)
-				PUT(0xe0, n, b);
-			PUT((0x80|(c[i].sc & CODEMASK)), n, b);
+		if (!c[i].make && (c[i].sc & NOBREAK))
+			continue;
+
+		/* Each scancode takes at most two ints (E0 prefix). */
+		if (kd->vkbd_cnt + 2 > VKBD_BUFSZ)
+			kbd_vkbd_flush(kd);
+
+		if (kd->in_stamped && !kd->vkbd_stamped) {
+			kd->vkbd_ts = kd->in_ts;
+			kd->vkbd_stamped = 1;
 		}
+		b = &kd->vkbd_buf[kd->vkbd_cnt];
+		if (c[i].sc & E0PREFIX)
+			PUT(0xe0, kd->vkbd_cnt, b);
+		if (c[i].make)
+			PUT((c[i].sc & CODEMASK), kd->vkbd_cnt, b);
+		else
+			PUT((0x80|(c[i].sc & CODEMASK)), kd->vkbd_cnt, b);
 	}
+}
+
+static void
+kbd_vkbd_flush(struct kbd_dev *kd)
+{
+	struct hid_interface *hi = hid_appcol_get_parser_private(kd->ha);
+	ssize_t len;
+
+	if (kd->vkbd_cnt == 0)
+		return;
+
+	len = kd->vkbd_cnt * sizeof(kd->vkbd_buf[0]);
+	if (write(kd->vkbd_fd, kd->vkbd_buf, len) != len)
+		syslog(LOG_ERR, "%s[%d] write to vkbd failed: %m", hi->dev,
+		    hi->ndx);
+	kd->vkbd_cnt = 0;
 
-	if (n > 0)
-		write(kd->vkbd_fd, buf, n * sizeof(buf[0]));
+	if (kd->vkbd_stamped) {
+		hid_lathist_add(&kd->lat_vkbd, &kd->vkbd_ts);
+		kd->vkbd_stamped = 0;
+	}
 }
 
 static void
@@ -595,19 +741,19 @@ kbd_write_evdev(struct kbd_dev *kd, struct hid_key hk, int make, int repeat)
 	int key;
 
 	/* Ignore unmapped keys. */
-	if ((key = evdev_hid2key(&hk)) < 0) {
+	if ((key = kd->xlat_ev[kbd_page_index(hk.up)][hk.code]) < 0) {
 		PRINT1(1, "No evdev keymap for pressed key (%#x)\n",
 		    HID_USAGE2(hk.up, hk.code));
 		return;
 	}
 
 	if (repeat)
-		evdev_report_key_repeat_event(kd->evdev, key);
-	else
-		evdev_report_key_event(kd->evdev, ((hk.up << 16) | hk.code),
-		    key, make);
-
-	evdev_sync_report(kd->evdev);
+		evdev_frame_key_repeat(kd->evdev, key);
+	else {
+		evdev_frame_key(kd->evdev, ((hk.up << 16) | hk.code), key,
+		    make);
+		kd->ev_stamped |= kd->in_stamped;
+	}
 }
 
 static void
@@ -621,13 +767,82 @@ kbd_write(struct kbd_dev *kd, struct hid_key hk, int make, int repeat)
 		kbd_write_evdev(kd, hk, make, repeat);
 }
 
+static int
+kbd_page_index(uint16_t up)
+{
+
+	switch (up) {
+	case HUP_KEYBOARD:
+		return (KBD_PAGE_KEYBOARD);
+	case HUP_CONSUMER:
+		return (KBD_PAGE_CONSUMER);
+	default:
+		return (-1);
+	}
+}
+
+static int
+kbd_keypad_key(struct hid_key hk)
+{
+
+	return (hk.up == HUP_KEYBOARD &&
+	    (hk.code == 0x67 || (hk.code >= 0xB0 && hk.code <= 0xDD)));
+}
+
+/*
+ * Build the translation tables. The evdev codes are all resolved here.
+ * The scancodes of the keyboard page are resolved here too, except
+ * for the keypad keys; those of the other pages are resolved by the
+ * translator the first time the key is seen (for cc, that may assign
+ * a free key). A translator must return the same scancode for a key
+ * every time, unless it is a keypad key.
+ */
+static void
+kbd_build_xlat(struct kbd_dev *kd)
+{
+	struct hid_scancode c[8];
+	struct hid_key hk;
+	int code, nk, p;
+
+	for (p = 0; p < KBD_NPAGE; p++) {
+		for (code = 0; code < KBD_NCODE; code++) {
+			hk = kbd_bit2key(p, code);
+			kd->xlat_ev[p][code] = evdev_hid2key(&hk);
+			kd->xlat_sc[p][code] = XLAT_SLOW;
+			if (p != KBD_PAGE_KEYBOARD || code >= xsize ||
+			    kbd_keypad_key(hk))
+				continue;
+			nk = kd->tr[p](kd->tr_ha[p], hk, 1, c,
+			    sizeof(c) / sizeof(c[0]));
+			if (nk <= 1)
+				kd->xlat_sc[p][code] = nk > 0 ? c[0].sc :
+				    XLAT_NONE;
+		}
+	}
+}
+
+static struct hid_key
+kbd_bit2key(int page, int bit)
+{
+	struct hid_key hk;
+
+	hk.up = page == KBD_PAGE_KEYBOARD ? HUP_KEYBOARD : HUP_CONSUMER;
+	hk.code = bit;
+
+	return (hk);
+}
+
 static void
 kbd_process_keys(struct kbd_dev *kd)
 {
+	struct kbd_dev *m;
+	struct hid_key hk;
 	uint32_t n_mod;
 	uint32_t o_mod;
-	uint16_t key, up;
-	int dtime, i, j, repeat;
+	uint32_t d, t;
+	int armed, b, i, n, p, pressed, w;
+
+	kd->now = hid_timer_ms();
 
 	n_mod = kd->ndata.mod;
 	o_mod = kd->odata.mod;
@@ -641,72 +856,177 @@ kbd_process_keys(struct kbd_dev *kd)
 		}
 	}
 
-	/* Check for released keys. */
-	for (i = 0; i < kd->key_cnt; i++) {
-		key = kd->odata.keycode[i].code;
-		up = kd->odata.keycode[i].up;
-		if (key == 0) {
-			continue;
-		}
-		for (j = 0; j < kd->key_cnt; j++) {
-			if (kd->ndata.keycode[j].code == 0) {
+	/*
+	 * Released and pressed keys are the bits which differ between the
+	 * old and the new key state. Walk the changed bits only.
+	 */
+	pressed = 0;
+	for (p = 0; p < KBD_NPAGE; p++) {
+		for (w = 0; w < KBD_NWORD; w++) {
+			if (kd->odata.keys[p][w] == kd->ndata.keys[p][w])
 				continue;
+			d = kd->odata.keys[p][w] & ~kd->ndata.keys[p][w];
+			while (d != 0) {
+				b = ffs(d) - 1;
+				d &= d - 1;
+				hk = kbd_bit2key(p, w * 32 + b);
+				if (kd->rpt_held && kd->rpt_key.up == hk.up &&
+				    kd->rpt_key.code == hk.code)
+					kd->rpt_held = 0;
+				kbd_write(kd, hk, 0, 0);
 			}
-			if (key == kd->ndata.keycode[j].code &&
-			    up == kd->ndata.keycode[j].up) {
-				goto rfound;
+		}
+	}
+	for (p = 0; p < KBD_NPAGE; p++) {
+		for (w = 0; w < KBD_NWORD; w++) {
+			if (kd->odata.keys[p][w] == kd->ndata.keys[p][w])
+				continue;
+			d = kd->ndata.keys[p][w] & ~kd->odata.keys[p][w];
+			while (d != 0) {
+				b = ffs(d) - 1;
+				d &= d - 1;
+				hk = kbd_bit2key(p, w * 32 + b);
+				kbd_write(kd, hk, 1, 0);
+
+				/* The last key pressed does the autorepeat. */
+				kd->rpt_key = hk;
+				kd->rpt_time = kd->now + kd->delay1;
+				kd->rpt_held = 1;
+				pressed = 1;
 			}
 		}
-		kbd_write(kd, kd->odata.keycode[i], 0, 0);
-	rfound:
-		;
 	}
 
-	/* Check for pressed keys. */
-	for (i = 0; i < kd->key_cnt; i++) {
-		key = kd->ndata.keycode[i].code;
-		up = kd->ndata.keycode[i].up;
-		if (key == 0) {
+	/* Repeat the held key if its deadline is reached. */
+	if (kd->rpt_held && !pressed &&
+	    (int32_t) (kd->rpt_time - kd->now) <= 0) {
+		kbd_write(kd, kd->rpt_key, 1, 1);
+		kd->rpt_time = kd->now + kd->delay2;
+	}
+
+	kd->odata = kd->ndata;
+
+	/*
+	 * All the events of this pass make one evdev frame. Unless held,
+	 * write all the scancodes of this pass at once too.
+	 */
+	if (kd->use_evdev) {
+		evdev_frame_commit(kd->evdev);
+		if (kd->ev_stamped) {
+			hid_lathist_add(&kd->lat_evdev, &kd->in_ts);
+			kd->ev_stamped = 0;
+		}
+	}
+	if (!kd->held)
+		kbd_vkbd_flush(kd);
+
+	/*
+	 * The timer serves both the repeat and the debounce deadlines
+	 * (those of all the members).
+	 */
+	armed = kd->rpt_held;
+	t = kd->rpt_time;
+	n = atomic_load_explicit(&kd->nmbr, memory_order_acquire);
+	for (i = 0; i < n; i++) {
+		m = kd->mbr[i];
+		if (!m->db.db_pending)
 			continue;
+		if (!armed || (int32_t) ((uint32_t) m->db.db_next - t) < 0)
+			t = (uint32_t) m->db.db_next;
+		armed = 1;
+	}
+	if (armed)
+		hid_timer_arm(&kd->repeat_timer,
+		    MAX((int32_t) (t - kd->now), 0));
+	else
+		hid_timer_disarm(&kd->repeat_timer);
+}
+
+/*
+ * Press and release key hk n times. The scancodes are staged like
+ * those of kbd_process_keys(), so that they are written to vkbd at
+ * once; each press and each release is an evdev frame of its own,
+ * see evdev_frame_tap(). The key state is left alone.
+ */
+static void
+kbd_tap(struct kbd_dev *kd, struct hid_key hk, int n)
+{
+	struct hid_interface *hi = hid_appcol_get_parser_private(kd->ha);
+	int i, key;
+
+	if (kd->use_vkbd) {
+		for (i = 0; i < n; i++) {
+			kbd_write_vkbd(kd, hk, 1);
+			kbd_write_vkbd(kd, hk, 0);
 		}
-		kd->ndata.time[i] = kd->now + kd->delay1;
-		repeat = 0;
-		for (j = 0; j < kd->key_cnt; j++) {
-			if (kd->odata.keycode[j].code == 0) {
-				continue;
-			}
-			if (key == kd->odata.keycode[j].code &&
-			    up == kd->odata.keycode[j].up) {
-				/*
-				 * Key is still pressed.
-				 */
-				kd->ndata.time[i] = kd->odata.time[j];
-				dtime = (kd->odata.time[j] - kd->now);
-				if (!(dtime & 0x80000000)) {
-					/* time has not elapsed */
-					goto pfound;
-				}
-				kd->ndata.time[i] = kd->now + kd->delay2;
-				repeat = 1;
-				break;
-			}
+	}
+
+	if (kd->use_evdev) {
+		if ((key = kd->xlat_ev[kbd_page_index(hk.up)][hk.code]) < 0)
+			PRINT1(1, "No evdev keymap for pressed key (%#x)\n",
+			    HID_USAGE2(hk.up, hk.code));
+		else {
+			evdev_frame_tap(kd->evdev, (hk.up << 16) | hk.code,
+			    key, n);
+			kd->ev_stamped |= kd->in_stamped;
 		}
-		kbd_write(kd, kd->ndata.keycode[i], 1, repeat);
+	}
 
-		/*
-                 * If any other key is presently down, force its repeat to be
-                 * well in the future (100s).  This makes the last key to be
-                 * pressed do the autorepeat.
-                 */
-		for (j = 0; j < kd->key_cnt; j++) {
-			if (j != i)
-				kd->ndata.time[j] = kd->now + (100 * 1000);
+	if (kd->ev_stamped) {
+		hid_lathist_add(&kd->lat_evdev, &kd->in_ts);
+		kd->ev_stamped = 0;
+	}
+	if (!kd->held)
+		kbd_vkbd_flush(kd);
+}
+
+/*
+ * Switch chatter filter (see hid_debounce_key()). A suppressed
+ * transition leaves the key in its old state in ndata, and the timer
+ * re-evaluates it against the latest input (kept in rdata) once the
+ * window is over. Only the keys which differ from the output state are
+ * visited. A fresh input report counts the suppressed transitions.
+ */
+static void
+kbd_debounce(struct kbd_dev *kd, int fresh)
+{
+	struct kbd_data raw;
+	uint32_t d, rd;
+	int b, p, w;
+
+	hid_debounce_begin(&kd->db, hid_timer_ms64());
+	kd->now = (uint32_t) kd->db.db_now;
+	if (!fresh)
+		kd->ndata = kd->rdata;
+	raw = kd->ndata;
+
+	d = kd->ndata.mod ^ kd->odata.mod;
+	rd = kd->rdata.mod ^ raw.mod;
+	while (d != 0) {
+		b = ffs(d) - 1;
+		d &= d - 1;
+		if (hid_debounce_key(&kd->db, KBD_PAGE_KEYBOARD * KBD_NCODE +
+		    0xe0 + b, rd & (1U << b)))
+			kd->ndata.mod ^= 1U << b;
+	}
+
+	for (p = 0; p < KBD_NPAGE; p++) {
+		for (w = 0; w < KBD_NWORD; w++) {
+			d = kd->ndata.keys[p][w] ^ kd->odata.keys[p][w];
+			if (d == 0)
+				continue;
+			rd = kd->rdata.keys[p][w] ^ raw.keys[p][w];
+			while (d != 0) {
+				b = ffs(d) - 1;
+				d &= d - 1;
+				if (hid_debounce_key(&kd->db, p * KBD_NCODE +
+				    w * 32 + b, rd & (1U << b)))
+					kd->ndata.keys[p][w] ^= 1U << b;
+			}
 		}
-	pfound:
-		;
 	}
 
-	kd->odata = kd->ndata;
+	kd->rdata = raw;
 }
 
 int
@@ -732,10 +1052,10 @@ int
 kbd_attach(struct hid_appcol *ha)
 {
 	struct hid_interface *hi;
-	struct kbd_dev *kd;
-	struct stat sb;
+	struct kbd_dev *kd, *out;
 	const char *drv_name;
 	enum attach_mode mode;
+	int n;
 
 	hi = hid_appcol_get_parser_private(ha);
 	assert(hi != NULL);
@@ -759,6 +1079,58 @@ kbd_attach(struct hid_appcol *ha)
 	else
 		mode = config_kbd_attach(hi);
 	assert(mode > ATTACH_NO);
+
+	if (config_kbd_merge(hi) > 0) {
+		if ((out = kbd_merge_attach(kd, mode)) == NULL)
+			return (-1);
+	} else {
+		out = kd;
+		if (kbd_out_init(out, mode) < 0)
+			return (-1);
+	}
+	kd->out = out;
+
+	if ((n = config_kbd_debounce(hi)) > 0) {
+		if (hid_debounce_init(&kd->db, n, KBD_NPAGE * KBD_NCODE) < 0) {
+			syslog(LOG_ERR, "calloc failed in kbd_attach: %m");
+			return (-1);
+		}
+		PRINT1(1, "kbd debounce window: %dms\n", n);
+	}
+
+	atomic_init(&kd->inq_head, 0);
+	atomic_init(&kd->inq_tail, 0);
+
+	kbd_set_tr(ha, kbd_hid2key);
+
+	/*
+	 * Only drive the LEDs if it's a real keyboard with LEDs. (e.g. not
+	 * for comsumer control device)
+	 */
+	kd->leds = -1;
+	atomic_init(&kd->led_req, -1);
+	if (out->use_vkbd && strcmp(drv_name, "kbd") == 0)
+		kbd_find_leds(kd);
+
+	if (kbd_join(out, kd) < 0)
+		return (-1);
+
+	return (0);
+}
+
+/*
+ * Set up the output side of kd: the vkbd and evdev devices, the
+ * translation and the repeat.
+ */
+static int
+kbd_out_init(struct kbd_dev *kd, enum attach_mode mode)
+{
+	struct hid_interface *hi;
+	struct stat sb;
+
+	hi = hid_appcol_get_parser_private(kd->ha);
+	assert(hi != NULL);
+
 	if (mode == ATTACH_YES)
 		kd->use_vkbd = 1;
 	else if (mode == ATTACH_EVDEV)
@@ -810,197 +1182,678 @@ kbd_attach(struct hid_appcol *ha)
 	kd->delay1 = KB_DELAY1;
 	kd->delay2 = KB_DELAY2;
 
-	kbd_set_tr(ha, kbd_hid2key);
+	kd->vkbd_leds = -1;
+	atomic_init(&kd->nmbr, 0);
+	atomic_init(&kd->work, 0);
+	atomic_init(&kd->busy, 0);
+	hid_timer_init(&kd->repeat_timer, kbd_repeat, kd);
+	hid_timer_init(&kd->led_timer, kbd_led_sync, kd);
 
-	pthread_mutex_init(&kd->kbd_mtx, NULL);
-	pthread_create(&kd->kbd_task, NULL, kbd_task, kd);
+	return (0);
+}
 
-	/*
-	 * Only start keyboard status task if it's a real keyboard.
-	 * (e.g. should not start task for comsumer control device)
-	 */
-	if (kd->use_vkbd && strcmp(drv_name, "kbd") == 0)
-		pthread_create(&kd->kbd_status_task, NULL, kbd_status_task, ha);
+/*
+ * With kbd_merge, all the keyboards of the process share one output
+ * device, created by the first of them to attach, and named after it.
+ * Each keyboard keeps its input queue, debounce state and LED reports,
+ * and is a member of the output device; the output pass merges the key
+ * state of the members, so that modifiers apply across keyboards and
+ * one repeat serves them all.
+ */
+static struct kbd_dev *
+kbd_merge_attach(struct kbd_dev *kd, enum attach_mode mode)
+{
+	struct hid_interface *hi;
+	struct kbd_dev *out;
+
+	hi = hid_appcol_get_parser_private(kd->ha);
+	assert(hi != NULL);
+
+	pthread_mutex_lock(&merge_mtx);
+	if ((out = kbd_merged) == NULL) {
+		if ((out = calloc(1, sizeof(*out))) == NULL) {
+			syslog(LOG_ERR, "calloc failed in kbd_merge_attach:"
+			    " %m");
+			goto done;
+		}
+		out->ha = kd->ha;
+		out->out = out;
+		if (kbd_out_init(out, mode) < 0) {
+			free(out);
+			out = NULL;
+			goto done;
+		}
+		kbd_merged = out;
+		PRINT1(1, "kbd merged device created\n");
+		goto done;
+	}
+
+	if ((mode != ATTACH_EVDEV) != out->use_vkbd ||
+	    (mode != ATTACH_YES) != out->use_evdev)
+		PRINT1(1, "attach mode of the merged device used\n");
+	if (out->use_evdev)
+		evdev_add_appcol(out->evdev, kd->ha);
+	PRINT1(1, "kbd merged with %s\n",
+	    hid_appcol_get_driver_name(out->ha));
+
+done:
+	pthread_mutex_unlock(&merge_mtx);
+
+	return (out);
+}
+
+/*
+ * Publish kd as a member of out. From now on the output pass of out
+ * reads the input queue of kd.
+ */
+static int
+kbd_join(struct kbd_dev *out, struct kbd_dev *kd)
+{
+	struct hid_interface *hi;
+	int n;
+
+	hi = hid_appcol_get_parser_private(kd->ha);
+	assert(hi != NULL);
+
+	pthread_mutex_lock(&merge_mtx);
+	n = atomic_load_explicit(&out->nmbr, memory_order_relaxed);
+	if (n >= KBD_NMEMBER) {
+		pthread_mutex_unlock(&merge_mtx);
+		syslog(LOG_ERR, "%s[%d] too many merged keyboards", hi->dev,
+		    hi->ndx);
+		return (-1);
+	}
+	out->mbr[n] = kd;
+	atomic_store_explicit(&out->nmbr, n + 1, memory_order_release);
+
+	/* Watch the status of the vkbd once there are LEDs to drive. */
+	if (kd->led_nhr > 0) {
+		if (!out->status_watched) {
+			hid_watch_add(&out->status_watch, out->vkbd_fd,
+			    kbd_status, out);
+			out->status_watched = 1;
+		}
+		hid_timer_arm(&out->led_timer, 0);
+	}
+	pthread_mutex_unlock(&merge_mtx);
 
 	return (0);
 }
 
+/*
+ * Keyboards report the keys pressed either as an array of keycodes
+ * (the boot protocol layout), or as a bitmap with one 1-bit variable
+ * per key (n-key rollover). The modifiers are a bitmap of usages
+ * 0xe0-0xe7 in both cases, possibly part of the NKRO bitmap itself.
+ */
 void
 kbd_recv(struct hid_appcol *ha, struct hid_report *hr)
 {
 	struct hid_interface *hi;
 	struct hid_field *hf;
-	struct hid_key keycodes[MAX_KEYCODE];
-	unsigned int usage;
-	int cnt, flags, i;
+	uint32_t keys[MAX_KEYCODE / 32];
+	unsigned int code, usage;
+	int flags, i;
 	uint8_t mod;
 
 	hi = hid_appcol_get_parser_private(ha);
 	assert(hi != NULL);
 	mod = 0;
-	cnt = 0;
+	memset(keys, 0, sizeof(keys));
 	hf = NULL;
 	while ((hf = hid_report_get_next_field(hr, hf, HID_INPUT)) != NULL) {
 		flags = hid_field_get_flags(hf);
 		if (flags & HIO_CONST)
 			continue;
 		usage = hid_field_get_usage_min(hf);
-		if (usage == HID_USAGE2(HUP_KEYBOARD, 224)) {
-			for (i = 0; i < hf->hf_count; i++)
-				mod |= hf->hf_value[i] << i;
-		}
-		if (usage == HID_USAGE2(HUP_KEYBOARD, 0)) {
-			cnt = hf->hf_count;
-			for (i = 0; i < cnt; i++) {
-				keycodes[i].code = HID_USAGE(hf->hf_usage[i]);
-				keycodes[i].up = HUP_KEYBOARD;
-			}
+		if (HID_PAGE(usage) != HUP_KEYBOARD)
+			continue;
+		for (i = 0; i < hf->hf_count; i++) {
+			if (hf->hf_value[i] == 0)
+				continue;
+			if ((flags & HIO_VARIABLE) && hf->hf_size != 1)
+				continue;
+			code = HID_USAGE(hf->hf_usage[i]);
+			if (code >= 0xe0 && code <= 0xe7)
+				mod |= 1 << (code - 0xe0);
+			else if (code != 0 && code < MAX_KEYCODE)
+				keys[code / 32] |= 1U << (code % 32);
 		}
 	}
 
 	if (verbose > 1) {
 		PRINT1(2, "mod(0x%02x) key codes: ", mod);
-		for (i = 0; i < cnt; i++)
-			printf("0x%02x ", keycodes[i].code);
+		for (code = 0; code < MAX_KEYCODE; code++)
+			if (keys[code / 32] & (1U << (code % 32)))
+				printf("0x%02x ", code);
 		putchar('\n');
 	}
 
-	kbd_input(ha, mod, keycodes, cnt);
+	kbd_input_bitmap(ha, mod, HUP_KEYBOARD, keys, MAX_KEYCODE);
+}
+
+static void
+kbd_hold(struct kbd_dev *kd)
+{
+
+	/* Hold the output until kbd_flush() is called. */
+	if (!kd->held) {
+		kd->held = 1;
+		if (kd->use_evdev)
+			evdev_hold(kd->evdev);
+	}
+}
+
+/*
+ * The key state, the repeat state and the output buffers belong to
+ * whichever thread runs the output pass: the receive path, or the
+ * timer thread for the repeat. The receive path never waits for it.
+ * It queues a snapshot of the input and leaves it to the running pass
+ * if there is one; likewise for the timer. The output is thus written
+ * by one thread at a time, in order, without any lock held.
+ */
+static struct kbd_data *
+kbd_input_slot(struct kbd_dev *kd)
+{
+	unsigned head, tail;
+
+	tail = atomic_load_explicit(&kd->inq_tail, memory_order_relaxed);
+	for (;;) {
+		head = atomic_load_explicit(&kd->inq_head,
+		    memory_order_acquire);
+		if (tail - head < KBD_INQ)
+			break;
+		/* Full, only while a pass is stuck in a write. */
+		if (kbd_run(kd->out, 0))
+			ucuse_poll_wakeup();
+		sched_yield();
+	}
+
+	return (&kd->inq[tail & (KBD_INQ - 1)]);
 }
 
+static void
+kbd_input_submit(struct kbd_dev *kd)
+{
+	struct hid_interface *hi = hid_appcol_get_parser_private(kd->ha);
+	unsigned tail;
+
+	tail = atomic_load_explicit(&kd->inq_tail, memory_order_relaxed);
+	kd->inq_ts[tail & (KBD_INQ - 1)] = hi->rx_ts;
+	atomic_store_explicit(&kd->inq_tail, tail + 1, memory_order_release);
+	if (kbd_run(kd->out, 0))
+		ucuse_poll_wakeup();
+}
+
+/*
+ * Post work for the output pass of kd (an output device), and run the
+ * pass unless another thread is running it. Returns non-zero if the
+ * caller should call ucuse_poll_wakeup().
+ */
+static int
+kbd_run(struct kbd_dev *kd, int work)
+{
+	int wakeup;
+
+	if (work != 0)
+		atomic_fetch_or(&kd->work, work);
+
+	wakeup = 0;
+	for (;;) {
+		if (atomic_exchange(&kd->busy, 1) != 0)
+			break;
+		kbd_drain(kd);
+		wakeup |= kd->wakeup;
+		kd->wakeup = 0;
+		atomic_store(&kd->busy, 0);
+
+		/* Work posted after the last check but before the store. */
+		if (!kbd_pending(kd))
+			break;
+	}
+
+	return (wakeup);
+}
+
+static int
+kbd_pending(struct kbd_dev *out)
+{
+	struct kbd_dev *m;
+	int i, n;
+
+	if (atomic_load(&out->work) != 0)
+		return (1);
+	n = atomic_load_explicit(&out->nmbr, memory_order_acquire);
+	for (i = 0; i < n; i++) {
+		m = out->mbr[i];
+		if (atomic_load(&m->inq_head) != atomic_load(&m->inq_tail))
+			return (1);
+	}
+
+	return (0);
+}
+
+/*
+ * The output pass. The input snapshots of each member are run through
+ * its debounce filter, then merged into the key state of the output.
+ */
+static void
+kbd_drain(struct kbd_dev *kd)
+{
+	struct kbd_data *kdata;
+	struct kbd_dev *m;
+	struct hid_key tap;
+	unsigned head, tail;
+	int i, n, ntap, work;
+
+	do {
+		n = atomic_load_explicit(&kd->nmbr, memory_order_acquire);
+		for (i = 0; i < n; i++) {
+			m = kd->mbr[i];
+			head = atomic_load_explicit(&m->inq_head,
+			    memory_order_relaxed);
+			tail = atomic_load_explicit(&m->inq_tail,
+			    memory_order_acquire);
+			for (; head != tail; head++) {
+				kdata = &m->inq[head & (KBD_INQ - 1)];
+				if ((ntap = kdata->ntap) > 0)
+					tap = kdata->tap;
+				else
+					m->ndata = *kdata;
+				kd->in_ts = m->inq_ts[head & (KBD_INQ - 1)];
+				atomic_store_explicit(&m->inq_head, head + 1,
+				    memory_order_release);
+				kd->in_stamped = 1;
+				if (kd->use_evdev)
+					evdev_frame_stamp(kd->evdev,
+					    &kd->in_ts);
+				kbd_hold(kd);
+				if (ntap > 0) {
+					kbd_tap(kd, tap, ntap);
+					kd->in_stamped = 0;
+					continue;
+				}
+				if (m->db.db_window > 0)
+					kbd_debounce(m, 1);
+				kbd_merge(kd);
+				kbd_process_keys(kd);
+				kd->in_stamped = 0;
+			}
+		}
+
+		work = atomic_exchange(&kd->work, 0);
+		if (work & KBD_WORK_TIMER) {
+			for (i = 0; i < n; i++) {
+				m = kd->mbr[i];
+				if (m->db.db_pending)
+					kbd_debounce(m, 0);
+			}
+			kbd_merge(kd);
+			kbd_process_keys(kd);
+		}
+		if ((work & KBD_WORK_FLUSH) && kd->held) {
+			kbd_vkbd_flush(kd);
+			if (kd->use_evdev)
+				kd->wakeup |= evdev_flush(kd->evdev);
+			kd->held = 0;
+		}
+	} while (work != 0);
+}
+
+/*
+ * The key state of merged keyboards is the union of the key states of
+ * the members (after debounce). Nothing to do for a keyboard which is
+ * its own output.
+ */
+static void
+kbd_merge(struct kbd_dev *out)
+{
+	struct kbd_dev *m;
+	int i, n, p, w;
+
+	n = atomic_load_explicit(&out->nmbr, memory_order_acquire);
+	if (n == 0 || out->mbr[0] == out)
+		return;
+
+	memset(&out->ndata, 0, sizeof(out->ndata));
+	for (i = 0; i < n; i++) {
+		m = out->mbr[i];
+		out->ndata.mod |= m->ndata.mod;
+		for (p = 0; p < KBD_NPAGE; p++)
+			for (w = 0; w < KBD_NWORD; w++)
+				out->ndata.keys[p][w] |= m->ndata.keys[p][w];
+		m->odata = m->ndata;
+	}
+}
+
+/*
+ * Queue a new input state: the modifiers mod and the keys pressed,
+ * given as a bitmap of the usages 0 to nbits - 1 of usage page up.
+ */
+void
+kbd_input_bitmap(struct hid_appcol *ha, uint8_t mod, uint16_t up,
+    uint32_t *keys, int nbits)
+{
+
+	kbd_input_pages(ha, mod, up == HUP_KEYBOARD ? keys : NULL,
+	    up == HUP_CONSUMER ? keys : NULL, nbits);
+}
+
+/*
+ * Same as kbd_input_bitmap(), with a bitmap for the keyboard page and
+ * one for the consumer page. Either may be NULL.
+ */
 void
-kbd_input(struct hid_appcol *ha, uint8_t mod, struct hid_key *keycodes,
-    int key_cnt)
+kbd_input_pages(struct hid_appcol *ha, uint8_t mod, uint32_t *kbd_keys,
+    uint32_t *cc_keys, int nbits)
 {
 	struct kbd_dev *kd;
-	int i;
+	struct kbd_data *kdata;
+	size_t len;
 
 	kd = hid_appcol_get_private(ha);
 	assert(kd != NULL);
-
-	KBD_LOCK;
-	kd->ndata.mod = mod;
-	for (i = 0; i < key_cnt; i++)
-		kd->ndata.keycode[i] = keycodes[i];
-	kd->key_cnt = key_cnt;
-	/*
-	 * Note that this call to kbd_process_keys is needed. If two adjacent
-	 * events are generated within 25ms, kbd_task may miss one of them.
-	 */
-	kbd_process_keys(kd);
-	KBD_UNLOCK;
+	assert(nbits % 32 == 0);
+
+	kdata = kbd_input_slot(kd);
+	kdata->mod = mod;
+	kdata->ntap = 0;
+	memset(kdata->keys, 0, sizeof(kdata->keys));
+	len = MIN(nbits, KBD_NCODE) / 32 * sizeof(uint32_t);
+	if (kbd_keys != NULL)
+		memcpy(kdata->keys[KBD_PAGE_KEYBOARD], kbd_keys, len);
+	if (cc_keys != NULL)
+		memcpy(kdata->keys[KBD_PAGE_CONSUMER], cc_keys, len);
+	/* Usage 0 means no key. */
+	kdata->keys[KBD_PAGE_KEYBOARD][0] &= ~1U;
+	kdata->keys[KBD_PAGE_CONSUMER][0] &= ~1U;
+	kbd_input_submit(kd);
 }
 
+/*
+ * Press and release key hk n times, without changing the keys pressed.
+ * One queue entry and one output pass, whatever n is.
+ */
 void
-kbd_set_tr(struct hid_appcol *ha, hid_translator tr)
+kbd_input_tap(struct hid_appcol *ha, struct hid_key hk, int n)
 {
 	struct kbd_dev *kd;
+	struct kbd_data *kdata;
 
 	kd = hid_appcol_get_private(ha);
 	assert(kd != NULL);
 
-	kd->kbd_tr = tr;
+	if (n <= 0 || hk.code == 0 || hk.code >= KBD_NCODE ||
+	    kbd_page_index(hk.up) < 0)
+		return;
+
+	kdata = kbd_input_slot(kd);
+	kdata->tap = hk;
+	kdata->ntap = n;
+	kbd_input_submit(kd);
 }
 
-static void *
-kbd_task(void *arg)
+int
+kbd_flush(struct hid_appcol *ha)
 {
 	struct kbd_dev *kd;
+	int leds;
 
-	kd = arg;
+	kd = hid_appcol_get_private(ha);
+	assert(kd != NULL);
+
+	/* LED state posted by kbd_led_sync(). */
+	if ((leds = atomic_exchange(&kd->led_req, -1)) >= 0)
+		kbd_send_leds(kd, leds);
+
+	return (kbd_run(kd->out, KBD_WORK_FLUSH));
+}
+
+/*
+ * Called at attach time, before any input from ha. A keyboard which
+ * is its own output uses tr for all the pages. The translator of the
+ * keyboard page of merged keyboards is that of the kbd driver, and
+ * the translator of the consumer page that of the cc driver; the
+ * first translator set serves the pages nobody claimed yet.
+ */
+void
+kbd_set_tr(struct hid_appcol *ha, hid_translator tr)
+{
+	struct kbd_dev *kd, *out;
+	int own, p;
+
+	kd = hid_appcol_get_private(ha);
 	assert(kd != NULL);
+	out = kd->out;
+	assert(out != NULL);
 
-	for (kd->now = 0; ; kd->now += 25) {
-		KBD_LOCK;
-		kbd_process_keys(kd);
-		KBD_UNLOCK;
-		usleep(25 * 1000);	/* wake up every 25ms. */
+	if (strcmp(hid_appcol_get_driver_name(ha), "cc") == 0)
+		own = KBD_PAGE_CONSUMER;
+	else
+		own = KBD_PAGE_KEYBOARD;
+
+	/* The output pass may be running for the other members. */
+	while (atomic_exchange(&out->busy, 1) != 0)
+		sched_yield();
+	for (p = 0; p < KBD_NPAGE; p++) {
+		if (out == kd || out->tr[p] == NULL || p == own) {
+			out->tr[p] = tr;
+			out->tr_ha[p] = ha;
+		}
 	}
+	kbd_build_xlat(out);
+	atomic_store(&out->busy, 0);
 
-	return (NULL);
+	if (kbd_pending(out) && kbd_run(out, 0))
+		ucuse_poll_wakeup();
 }
 
-static void *
-kbd_status_task(void *arg)
+/*
+ * Latency of the keystrokes, from the arrival of the report to the
+ * vkbd write, to the evdev enqueue and to the client read; and per-key
+ * count of the transitions suppressed by the debounce filter, for
+ * spotting worn switches.
+ */
+void
+kbd_stats(struct hid_appcol *ha, FILE *fp)
+{
+	struct kbd_dev *kd, *out;
+	struct hid_key hk;
+	const char *name;
+	char buf[64];
+	int i, n;
+
+	kd = hid_appcol_get_private(ha);
+	if (kd == NULL)
+		return;
+
+	/* The latency of merged keyboards is that of their output. */
+	name = hid_appcol_get_driver_name(ha);
+	out = kd->out;
+	if (out->ha != ha)
+		goto debounce;
+	if (out->use_vkbd) {
+		snprintf(buf, sizeof(buf), "%s%s vkbd write",
+		    out != kd ? "merged " : "", name);
+		hid_lathist_dump(&out->lat_vkbd, fp, buf);
+	}
+	if (out->use_evdev) {
+		snprintf(buf, sizeof(buf), "%s%s evdev enqueue",
+		    out != kd ? "merged " : "", name);
+		hid_lathist_dump(&out->lat_evdev, fp, buf);
+		snprintf(buf, sizeof(buf), "%s%s evdev read",
+		    out != kd ? "merged " : "", name);
+		evdev_stats(out->evdev, fp, buf);
+	}
+
+debounce:
+
+	if (kd->db.db_cnt == NULL)
+		return;
+	fprintf(fp, "\t%s debounce %dms suppressed:", name,
+	    kd->db.db_window);
+	for (i = n = 0; i < KBD_NPAGE * KBD_NCODE; i++) {
+		if (kd->db.db_cnt[i] == 0)
+			continue;
+		hk = kbd_bit2key(i / KBD_NCODE, i % KBD_NCODE);
+		fprintf(fp, " %#x:%u", HID_USAGE2(hk.up, hk.code),
+		    kd->db.db_cnt[i]);
+		n++;
+	}
+	if (n == 0)
+		fputs(" none", fp);
+	fputc('\n', fp);
+}
+
+/*
+ * Called by the timer thread when the repeat deadline of a held key, or
+ * the end of a debounce window of a member, is reached.
+ */
+static void
+kbd_repeat(void *arg)
+{
+	struct kbd_dev *kd;
+
+	kd = arg;
+	assert(kd != NULL);
+
+	if (kbd_run(kd, KBD_WORK_TIMER))
+		ucuse_poll_wakeup();
+}
+
+/*
+ * Remember the output reports which have LED fields.
+ */
+static void
+kbd_find_leds(struct kbd_dev *kd)
 {
-	struct hid_interface *hi;
-	struct hid_appcol *ha;
 	struct hid_report *hr;
 	struct hid_field *hf;
+
+	hr = NULL;
+	while ((hr = hid_appcol_get_next_report(kd->ha, hr)) != NULL &&
+	    kd->led_nhr < KBD_NLEDRPT) {
+		hf = NULL;
+		while ((hf = hid_report_get_next_field(hr, hf, HID_OUTPUT)) !=
+		    NULL) {
+			if (hid_field_get_flags(hf) & HIO_CONST)
+				continue;
+			if (hid_field_get_usage_page(hf) == HUP_LEDS) {
+				kd->led_hr[kd->led_nhr++] = hr;
+				break;
+			}
+		}
+	}
+}
+
+/*
+ * Called by the timer thread when the vkbd status changed. The LED
+ * output reports of a member are only sent if its LEDs changed.
+ */
+static void
+kbd_status(void *arg)
+{
+	struct hid_interface *hi;
 	struct kbd_dev *kd;
 	vkbd_status_t vs;
-	unsigned int usage;
-	int flags, found, len, i;
+	int len;
 
-	ha = arg;
-	assert(ha != NULL);
-	hi = hid_appcol_get_parser_private(ha);
+	kd = arg;
+	assert(kd != NULL);
+	hi = hid_appcol_get_parser_private(kd->ha);
 	assert(hi != NULL);
-	kd = hid_appcol_get_private(ha);
+
+	len = read(kd->vkbd_fd, &vs, sizeof(vs));
+	if (len < 0) {
+		if (errno == EINTR || errno == EAGAIN)
+			return;
+		syslog(LOG_ERR, "%s[%d] vkbd status read failed: %m",
+		    hi->dev, hi->ndx);
+		/* kbd_join() adds the watch again for the next member. */
+		pthread_mutex_lock(&merge_mtx);
+		hid_watch_del(&kd->status_watch);
+		kd->status_watched = 0;
+		pthread_mutex_unlock(&merge_mtx);
+		return;
+	}
+	if (len != sizeof(vs))
+		return;
+
+	PRINT1(1, "kbd status changed: leds=0x%x\n", vs.leds);
+	kd->vkbd_leds = vs.leds & (LED_NUM | LED_CAP | LED_SCR);
+	kbd_led_sync(kd);
+}
+
+/*
+ * Bring the LEDs of the members of kd in line with those of its vkbd.
+ * Runs on the timer thread, on a status change or when a member joins.
+ * The output reports are sent by kbd_flush() on the dispatch thread of
+ * the member, so that a stalled device never holds up the timer thread
+ * and the other keyboards.
+ */
+static void
+kbd_led_sync(void *arg)
+{
+	struct hid_interface *hi;
+	struct kbd_dev *kd, *m;
+	int i, n;
+
+	kd = arg;
 	assert(kd != NULL);
 
-	for (;;) {
-		len = read(kd->vkbd_fd, &vs, sizeof(vs));
-		if (len < 0) {
-			if (errno != EINTR)
-				break;
-			continue;
+	if (kd->vkbd_leds < 0)
+		return;
+	n = atomic_load_explicit(&kd->nmbr, memory_order_acquire);
+	for (i = 0; i < n; i++) {
+		m = kd->mbr[i];
+		if (m->led_nhr > 0 && m->leds != kd->vkbd_leds) {
+			m->leds = kd->vkbd_leds;
+			atomic_store(&m->led_req, m->leds);
+			hi = hid_appcol_get_parser_private(m->ha);
+			assert(hi != NULL);
+			hid_ring_notify(hi->ring);
 		}
-		PRINT1(1, "kbd status changed: leds=0x%x\n", vs.leds);
-		hr = NULL;
-		while ((hr = hid_appcol_get_next_report(ha, hr)) != NULL) {
-			found = 0;
-			hf = NULL;
-			while ((hf = hid_report_get_next_field(hr, hf,
-			    HID_OUTPUT)) != NULL) {
-				flags = hid_field_get_flags(hf);
-				if (flags & HIO_CONST)
-					continue;
-				usage = hid_field_get_usage_page(hf);
-				if (usage != HUP_LEDS)
-					continue;
-				found = 1;
-				for (i = 0; i < hf->hf_count; i++) {
-					hid_field_get_usage_value(hf, i, &usage,
-					    NULL);
-					switch (HID_USAGE(usage)) {
-					case HUG_NUM_LOCK:
-						if (vs.leds & LED_NUM)
-							hid_field_set_value(hf,
-							    i, 1);
-						else
-							hid_field_set_value(hf,
-							    i, 0);
-						break;
-					case HUG_CAPS_LOCK:
-						if (vs.leds & LED_CAP)
-							hid_field_set_value(hf,
-							    i, 1);
-						else
-							hid_field_set_value(hf,
-							    i, 0);
-						break;
-					case HUG_SCROLL_LOCK:
-						if (vs.leds & LED_SCR)
-							hid_field_set_value(hf,
-							    i, 1);
-						else
-							hid_field_set_value(hf,
-							    i, 0);
-						break;
-					default:
-						hid_field_set_value(hf, i, 0);
-						break;
-					}
+	}
+}
 
+static void
+kbd_send_leds(struct kbd_dev *kd, int leds)
+{
+	struct hid_report *hr;
+	struct hid_field *hf;
+	unsigned int usage;
+	int i, j, v;
+
+	for (j = 0; j < kd->led_nhr; j++) {
+		hr = kd->led_hr[j];
+		hf = NULL;
+		while ((hf = hid_report_get_next_field(hr, hf, HID_OUTPUT)) !=
+		    NULL) {
+			if (hid_field_get_flags(hf) & HIO_CONST)
+				continue;
+			if (hid_field_get_usage_page(hf) != HUP_LEDS)
+				continue;
+			for (i = 0; i < hf->hf_count; i++) {
+				hid_field_get_usage_value(hf, i, &usage, NULL);
+				switch (HID_USAGE(usage)) {
+				case HUG_NUM_LOCK:
+					v = (leds & LED_NUM) != 0;
+					break;
+				case HUG_CAPS_LOCK:
+					v = (leds & LED_CAP) != 0;
+					break;
+				case HUG_SCROLL_LOCK:
+					v = (leds & LED_SCR) != 0;
+					break;
+				default:
+					v = 0;
+					break;
 				}
+				hid_field_set_value(hf, i, v);
 			}
-			if (found)
-				hid_appcol_xfer_data(ha, hr);
 		}
+		hid_appcol_xfer_data(kd->ha, hr);
 	}
-
-	return (NULL);
 }
 
 /*
@@ -1072,8 +1925,11 @@ keypad_hid2key(struct hid_appcol *ha, struct hid_key hk, int make,
 	uint32_t o_mod;
 	int i, kc, nk;
 
+	/* The keypad map and the modifiers are those of the output. */
 	kd = hid_appcol_get_private(ha);
 	assert(kd != NULL);
+	kd = kd->out;
+	assert(kd != NULL);
 
 	assert(c != NULL && len > 0);
 	assert(hk.code == 0x67 || (hk.code >= 0xB0 && hk.code <= 0xDD));
@@ -1105,6 +1961,7 @@ keypad_hid2key(struct hid_appcol *ha, struct hid_key hk, int make,
 	 * If the keypad key is generated by a comsuer controller,
 	 * we should use the modfier key status from the keyboard interface
 	 * instead, if it's us not ukbd(4) handling the keyboard interface.
+	 * (kbd_merge does that for the keyboards of the same device.)
 	 */
 
 	n_mod = kd->kpm[kc].mod;
@@ -1155,6 +2012,31 @@ keypad_hid2key(struct hid_appcol *ha, struct hid_key hk, int make,
 
 #define KEYMAP_PATH1 "/usr/share/syscons/keymaps"
 #define KEYMAP_PATH2 "/usr/share/vt/keymaps"
+#define KEYMAP_CACHE "/var/run/uhidd.keymap.cache"
+
+/*
+ * The keypad translation resolved from a keymap file is cached, both
+ * in memory for the other keyboards of this process, and in
+ * KEYMAP_CACHE for the other uhidd processes. The cache is keyed by
+ * the path, the mtime and the size of the keymap file. The cache file
+ * is a header followed by kxsize struct keypad_map.
+ */
+struct keymap_cache_hdr {
+	char		kc_magic[8];
+	uint32_t	kc_version;
+	uint32_t	kc_nkey;
+	int64_t		kc_mtime;
+	int64_t		kc_mtime_nsec;
+	int64_t		kc_size;
+	int32_t		kc_cnt;
+	char		kc_path[256];
+};
+
+#define	KEYMAP_CACHE_MAGIC	"UHIDDKPM"
+#define	KEYMAP_CACHE_VERSION	1
+
+static struct keymap_cache_hdr keymap_cache;	/* Protected by keymap_mtx. */
+static struct keypad_map keymap_cache_kpm[kxsize];
 
 int kbdmap_number;
 char kbdmap_letter;
@@ -1243,7 +2125,8 @@ keypad_search_key(struct kbd_dev *kd, int sc, int state, char letter)
 }
 
 static int
-keypad_parse_keymap(struct kbd_dev *kd, const char *keymap_file)
+keypad_parse_keymap(struct kbd_dev *kd, const char *keymap_file,
+    struct stat *sb)
 {
 	struct hid_interface *hi;
 	struct hid_appcol *ha;
@@ -1254,7 +2137,18 @@ keypad_parse_keymap(struct kbd_dev *kd, const char *keymap_file)
 	hi = hid_appcol_get_parser_private(ha);
 	assert(hi != NULL);
 
+	/* The keymap scanner is not reentrant. */
+	pthread_mutex_lock(&keymap_mtx);
+
+	if ((cnt = keypad_load_cache(kd, keymap_file, sb)) > 0) {
+		pthread_mutex_unlock(&keymap_mtx);
+		PRINT1(3, "keypad translation for %s loaded from cache\n",
+		    keymap_file);
+		return (cnt);
+	}
+
 	if ((kbdmapin = fopen(keymap_file, "r")) == NULL) {
+		pthread_mutex_unlock(&keymap_mtx);
 		PRINT1(3, "could not open %s", keymap_file);
 		return (-1);
 	}
@@ -1301,10 +2195,135 @@ keypad_parse_keymap(struct kbd_dev *kd, const char *keymap_file)
 
 parse_done:
 	fclose(kbdmapin);
+	if (cnt > 0)
+		keypad_save_cache(kd, keymap_file, sb, cnt);
+	pthread_mutex_unlock(&keymap_mtx);
 
 	return (cnt);
 }
 
+/*
+ * Look up the keypad translation of the keymap file in the cache.
+ * Returns the number of keys found, or 0 on a cache miss. Called with
+ * keymap_mtx held.
+ */
+static int
+keypad_load_cache(struct kbd_dev *kd, const char *keymap_file,
+    struct stat *sb)
+{
+	struct keymap_cache_hdr h;
+	FILE *fp;
+	int ok;
+
+	if (strlen(keymap_file) >= sizeof(h.kc_path))
+		return (0);
+
+	/* Same keymap as the previous keyboard of this process? */
+	h = keymap_cache;
+	if (h.kc_cnt > 0 && strcmp(h.kc_path, keymap_file) == 0 &&
+	    h.kc_mtime == (int64_t) sb->st_mtim.tv_sec &&
+	    h.kc_mtime_nsec == (int64_t) sb->st_mtim.tv_nsec &&
+	    h.kc_size == (int64_t) sb->st_size) {
+		memcpy(kd->kpm, keymap_cache_kpm, sizeof(kd->kpm));
+		return (h.kc_cnt);
+	}
+
+	if ((fp = fopen(KEYMAP_CACHE, "r")) == NULL)
+		return (0);
+	ok = fread(&h, sizeof(h), 1, fp) == 1 &&
+	    memcmp(h.kc_magic, KEYMAP_CACHE_MAGIC, sizeof(h.kc_magic)) == 0 &&
+	    h.kc_version == KEYMAP_CACHE_VERSION && h.kc_nkey == kxsize &&
+	    h.kc_path[sizeof(h.kc_path) - 1] == '\0' &&
+	    strcmp(h.kc_path, keymap_file) == 0 &&
+	    h.kc_mtime == (int64_t) sb->st_mtim.tv_sec &&
+	    h.kc_mtime_nsec == (int64_t) sb->st_mtim.tv_nsec &&
+	    h.kc_size == (int64_t) sb->st_size && h.kc_cnt > 0 &&
+	    fread(keymap_cache_kpm, sizeof(keymap_cache_kpm), 1, fp) == 1;
+	fclose(fp);
+	if (!ok)
+		return (0);
+
+	keymap_cache = h;
+	memcpy(kd->kpm, keymap_cache_kpm, sizeof(kd->kpm));
+
+	return (h.kc_cnt);
+}
+
+/*
+ * Store the keypad translation just parsed from the keymap file in the
+ * cache. Called with keymap_mtx held.
+ */
+static void
+keypad_save_cache(struct kbd_dev *kd, const char *keymap_file,
+    struct stat *sb, int cnt)
+{
+	struct keymap_cache_hdr *h;
+	char tpath[PATH_MAX];
+	FILE *fp;
+
+	h = &keymap_cache;
+	if (strlen(keymap_file) >= sizeof(h->kc_path))
+		return;
+	memset(h, 0, sizeof(*h));
+	memcpy(h->kc_magic, KEYMAP_CACHE_MAGIC, sizeof(h->kc_magic));
+	h->kc_version = KEYMAP_CACHE_VERSION;
+	h->kc_nkey = kxsize;
+	h->kc_mtime = sb->st_mtim.tv_sec;
+	h->kc_mtime_nsec = sb->st_mtim.tv_nsec;
+	h->kc_size = sb->st_size;
+	h->kc_cnt = cnt;
+	strlcpy(h->kc_path, keymap_file, sizeof(h->kc_path));
+	memcpy(keymap_cache_kpm, kd->kpm, sizeof(keymap_cache_kpm));
+
+	/* Replace the cache file atomically. */
+	snprintf(tpath, sizeof(tpath), "%s.%d", KEYMAP_CACHE, getpid());
+	if ((fp = fopen(tpath, "w")) == NULL)
+		return;
+	if (fwrite(h, sizeof(*h), 1, fp) != 1 ||
+	    fwrite(keymap_cache_kpm, sizeof(keymap_cache_kpm), 1, fp) != 1) {
+		fclose(fp);
+		unlink(tpath);
+		return;
+	}
+	fclose(fp);
+	if (rename(tpath, KEYMAP_CACHE) < 0)
+		unlink(tpath);
+}
+
+/*
+ * Find the keymap configured in /etc/rc.conf.
+ */
+static int
+keypad_rc_keymap(char *mapfile, size_t len)
+{
+	char line[1024], *p;
+	FILE *fp;
+	size_t n;
+
+	if ((fp = fopen("/etc/rc.conf", "r")) == NULL)
+		return (-1);
+
+	n = 0;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		for (p = line; *p == ' ' || *p == '\t'; p++)
+			;
+		if (*p == '#' || strstr(p, "keymap") == NULL ||
+		    (p = strchr(p, '=')) == NULL)
+			continue;
+		for (p++; *p != '\0' && *p != '=' && *p != '#'; p++) {
+			if (strchr(" \"'\t\r\n", *p) != NULL)
+				continue;
+			if (n < len - 1)
+				mapfile[n++] = *p;
+		}
+		break;
+	}
+	fclose(fp);
+	mapfile[n] = '\0';
+
+	return (n > 0 ? 0 : -1);
+}
+
 static void
 keypad_init(struct kbd_dev *kd)
 {
@@ -1312,7 +2331,6 @@ keypad_init(struct kbd_dev *kd)
 	struct hid_appcol *ha;
 	struct stat sb;
 	char buf[1024], mapfile[64];
-	FILE *fp;
 	int c, found;
 
 	ha = kd->ha;
@@ -1328,35 +2346,23 @@ keypad_init(struct kbd_dev *kd)
 	 */
 
 	found = 0;
-	snprintf(buf, sizeof(buf), "grep -m 1 keymap /etc/rc.conf |"
-	    " cut -d'=' -f 2 | tr -d '\\040\\042\\011\\012\\015'");
-	if ((fp = popen(buf, "r")) != NULL) {
-		if ((c = fread(mapfile, 1, sizeof(mapfile) - 1, fp)) > 1) {
-			mapfile[c] = '\0';
-			PRINT1(3, "searching for keymap %s\n", mapfile);
-			snprintf(buf, sizeof(buf), "%s/%s", KEYMAP_PATH1,
-			    mapfile);
-			if (stat(buf, &sb) == 0) {
-				found = 1;
-				goto parse_keymap;
-			}
+	if (keypad_rc_keymap(mapfile, sizeof(mapfile)) == 0) {
+		PRINT1(3, "searching for keymap %s\n", mapfile);
+		snprintf(buf, sizeof(buf), "%s/%s", KEYMAP_PATH1, mapfile);
+		if (stat(buf, &sb) == 0)
+			found = 1;
+		else {
 			snprintf(buf, sizeof(buf), "%s/%s", KEYMAP_PATH2,
 			    mapfile);
-			if (stat(buf, &sb) == 0) {
+			if (stat(buf, &sb) == 0)
 				found = 1;
-				goto parse_keymap;
-			}
-			PRINT1(3, "keymap %s not exist\n", mapfile);
+			else
+				PRINT1(3, "keymap %s not exist\n", mapfile);
 		}
 	}
 
-parse_keymap:
-
-	if (fp != NULL)
-		pclose(fp);
-
 	if (found) {
-		c = keypad_parse_keymap(kd, buf);
+		c = keypad_parse_keymap(kd, buf, &sb);
 		if (c > 0) {
 			PRINT1(3, "found %d keys for keymap\n", c);
 			return;
@@ -0,0 +1,656 @@
+/*-
+ * Copyright (c) 2009, 2010, 2012, 2015 Kai Wang
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * libusb20 transport.
+ */
+
+#include <sys/cdefs.h>
+__FBSDID("$FreeBSD$");
+
+#include <sys/param.h>
+#include <dev/usb/usb.h>
+#include <dev/usb/usbhid.h>
+#include <assert.h>
+#include <libusb20.h>
+#include <libusb20_desc.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include "uhidd.h"
+
+/*
+ * The device is enumerated and opened once, and the handle is shared
+ * by all the HID interfaces. Only one interface thread at a time waits
+ * on the handle and processes the completed transfers (the "leader"),
+ * the others sleep on the condition variable until their transfer is
+ * done or the leader steps down.
+ */
+struct usb_dev {
+	struct libusb20_device	*pdev;
+	int			 refcnt;
+	int			 leader;
+	pthread_mutex_t		 mtx;
+	pthread_cond_t		 cv;
+};
+
+struct usb_hid_data {
+	struct usb_dev			*udev;
+	struct libusb20_transfer	*xfer;
+	uint8_t				 ep;
+};
+
+/*
+ * Protects hi->ht_data against usb_close(), for the callers that are
+ * not the interface thread (e.g. SET_REPORT from the vkbd LED path).
+ */
+static pthread_mutex_t usb_data_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static int	usb_match(const char *dev);
+static int	find_device(const char *dev);
+static int	open_device(const char *dev, struct usb_dev *udev);
+static void	open_iface(const char *dev, struct usb_dev *udev,
+		    struct libusb20_interface *iface, int i);
+static void	usb_dev_ref(struct usb_dev *udev);
+static void	usb_dev_unref(struct usb_dev *udev);
+static int	usb_xfer_wait(struct usb_dev *udev,
+		    struct libusb20_transfer *xfer);
+static void	usb_set_protocol(struct hid_interface *hi);
+static int	alloc_hid_interface_be(struct hid_interface *hi);
+static int	usb_start(struct hid_interface *hi);
+static int	usb_read(struct hid_interface *hi, struct hid_xfer_batch *xb);
+static void	usb_close(struct hid_interface *hi);
+static int	usb_set_report(struct hid_interface *hi, int type,
+		    int report_id, char *buf, int len);
+static int	usb_kernel_driver_active(struct hid_interface *hi);
+static int	usb_detach_kernel_driver(struct hid_interface *hi);
+
+struct hid_transport libusb20_transport = {
+	.ht_name = "libusb20",
+	.ht_match = usb_match,
+	.ht_enumerate = find_device,
+	.ht_open = alloc_hid_interface_be,
+	.ht_start = usb_start,
+	.ht_read = usb_read,
+	.ht_close = usb_close,
+	.ht_set_report = usb_set_report,
+	.ht_kernel_driver_active = usb_kernel_driver_active,
+	.ht_detach_kernel_driver = usb_detach_kernel_driver,
+};
+
+static int
+usb_match(const char *dev)
+{
+	unsigned int bus, addr;
+
+	return (sscanf(dev, "ugen%u.%u", &bus, &addr) == 2);
+}
+
+static int
+find_device(const char *dev)
+{
+	struct libusb20_backend *backend;
+	struct libusb20_device *pdev;
+	struct usb_dev *udev;
+	unsigned int bus, addr;
+	int ret;
+
+	if (sscanf(dev, "ugen%u.%u", &bus, &addr) < 2) {
+		syslog(LOG_ERR, "%s not found", dev);
+		return (-1);
+	}
+
+	backend = libusb20_be_alloc_default();
+	if (backend == NULL) {
+		syslog(LOG_ERR, "can not alloc backend");
+		return (-1);
+	}
+
+	pdev = NULL;
+	while ((pdev = libusb20_be_device_foreach(backend, pdev)) != NULL) {
+		if (bus == libusb20_dev_get_bus_number(pdev) &&
+		    addr == libusb20_dev_get_address(pdev))
+			break;
+	}
+
+	/*
+	 * Take the device out of the backend, so that the backend and
+	 * the other devices on the bus can be released right away.
+	 */
+	if (pdev != NULL)
+		libusb20_be_dequeue_device(backend, pdev);
+	libusb20_be_free(backend);
+
+	if (pdev == NULL) {
+		syslog(LOG_ERR, "%s not found", dev);
+		return (-1);
+	}
+
+	if ((udev = calloc(1, sizeof(*udev))) == NULL) {
+		syslog(LOG_ERR, "calloc failed: %m");
+		exit(1);
+	}
+	udev->pdev = pdev;
+	udev->refcnt = 1;
+	pthread_mutex_init(&udev->mtx, NULL);
+	pthread_cond_init(&udev->cv, NULL);
+
+	ret = open_device(dev, udev);
+
+	/* Each registered interface holds its own reference. */
+	usb_dev_unref(udev);
+
+	return (ret);
+}
+
+static int
+open_device(const char *dev, struct usb_dev *udev)
+{
+	struct libusb20_device *pdev;
+	struct libusb20_config *config;
+	struct libusb20_interface *iface;
+	int cndx, e, i;
+
+	pdev = udev->pdev;
+	e = libusb20_dev_open(pdev, 32);
+	if (e != 0) {
+		syslog(LOG_ERR, "libusb20_dev_open %s failed", dev);
+		return (-1);
+	}
+
+	/*
+	 * Use current configuration.
+	 */
+	cndx = libusb20_dev_get_config_index(pdev);
+	config = libusb20_dev_alloc_config(pdev, cndx);
+	if (config == NULL) {
+		syslog(LOG_ERR, "Can not alloc config for %s", dev);
+		return (-1);
+	}
+
+	/*
+	 * Iterate each interface.
+	 */
+	for (i = 0; i < config->num_interface; i++) {
+		iface = &config->interface[i];
+		if (iface->desc.bInterfaceClass == LIBUSB20_CLASS_HID) {
+			PRINT0(1, dev, i, "HID interface\n");
+			open_iface(dev, udev, iface, i);
+		}
+	}
+
+	free(config);
+
+	return (0);
+}
+
+static void
+open_iface(const char *dev, struct usb_dev *udev,
+    struct libusb20_interface *iface, int ndx)
+{
+	struct LIBUSB20_DEVICE_DESC_DECODED *ddesc;
+	struct LIBUSB20_CONTROL_SETUP_DECODED req;
+	struct libusb20_device *pdev;
+	struct hid_interface *hi;
+	struct usb_hid_data *ud;
+	struct libusb20_endpoint *ep;
+	unsigned char rdesc[16384];
+	int desc, ds, e, j, pos, size;
+	uint16_t actlen;
+
+	pdev = udev->pdev;
+
+	/*
+	 * Get report descriptor.
+	 */
+
+	pos = 0;
+	size = iface->extra.len;
+	while (size > 2) {
+		if (libusb20_me_get_1(&iface->extra, pos + 1) == LIBUSB20_DT_HID)
+			break;
+		size -= libusb20_me_get_1(&iface->extra, pos);
+		pos += libusb20_me_get_1(&iface->extra, pos);
+	}
+	if (size <= 2)
+		return;
+	desc = pos + 6;
+	for (j = 0; j < libusb20_me_get_1(&iface->extra, pos + 5);
+	     j++, desc += j * 3) {
+		if (libusb20_me_get_1(&iface->extra, desc) ==
+		    LIBUSB20_DT_REPORT)
+			break;
+	}
+	if (j >= libusb20_me_get_1(&iface->extra, pos + 5))
+		return;
+	ds = libusb20_me_get_2(&iface->extra, desc + 1);
+	PRINT0(1, dev, ndx, "Report descriptor size = %d\n", ds);
+	LIBUSB20_INIT(LIBUSB20_CONTROL_SETUP, &req);
+	req.bmRequestType = LIBUSB20_ENDPOINT_IN |
+	    LIBUSB20_REQUEST_TYPE_STANDARD | LIBUSB20_RECIPIENT_INTERFACE;
+	req.bRequest = LIBUSB20_REQUEST_GET_DESCRIPTOR;
+	req.wValue = LIBUSB20_DT_REPORT << 8;
+	req.wIndex = ndx;
+	req.wLength = ds;
+	e = libusb20_dev_request_sync(pdev, &req, rdesc, &actlen, 0, 0);
+	if (e) {
+		syslog(LOG_ERR, "%s[%d]=> libusb20_dev_request_sync"
+		    " failed", dev, ndx);
+		return;
+	}
+
+	/*
+	 * Allocate a hid parent device. The protocol mode is set later
+	 * by alloc_hid_interface_be(), from the interface thread, so
+	 * the descriptors of all the interfaces are fetched back to back.
+	 */
+
+	hi = hid_interface_alloc(dev, ndx);
+	if ((ud = calloc(1, sizeof(*ud))) == NULL) {
+		syslog(LOG_ERR, "calloc failed: %m");
+		exit(1);
+	}
+	hi->ht = &libusb20_transport;
+	hi->ht_data = ud;
+	ud->udev = udev;
+	memcpy(hi->rdesc, rdesc, actlen);
+	hi->rsz = actlen;
+	ddesc = libusb20_dev_get_device_desc(pdev);
+	hi->vendor_id = ddesc->idVendor;
+	hi->product_id = ddesc->idProduct;
+	hi->iclass = iface->desc.bInterfaceClass;
+	hi->isubclass = iface->desc.bInterfaceSubClass;
+	hi->iproto = iface->desc.bInterfaceProtocol;
+
+	/*
+	 * Find the input interrupt endpoint.
+	 */
+
+	for (j = 0; j < iface->num_endpoints; j++) {
+		ep = &iface->endpoints[j];
+		if ((ep->desc.bmAttributes & LIBUSB20_TRANSFER_TYPE_MASK) ==
+		    LIBUSB20_TRANSFER_TYPE_INTERRUPT &&
+		    ((ep->desc.bEndpointAddress & LIBUSB20_ENDPOINT_DIR_MASK) ==
+		    LIBUSB20_ENDPOINT_IN)) {
+			ud->ep = ep->desc.bEndpointAddress;
+			hi->pkt_sz = ep->desc.wMaxPacketSize;
+			hi->binterval = ep->desc.bInterval;
+			PRINT1(1, "Find IN interrupt ep: %#x packet_size="
+			    "%#x\n", ud->ep, hi->pkt_sz);
+			break;
+		}
+	}
+	if (ud->ep == 0) {
+		PRINT1(0, "does not have IN interrupt ep\n");
+		free(ud);
+		free(hi);
+		return;
+	}
+
+	usb_dev_ref(udev);
+	hid_interface_register(hi);
+}
+
+static void
+usb_dev_ref(struct usb_dev *udev)
+{
+
+	pthread_mutex_lock(&udev->mtx);
+	udev->refcnt++;
+	pthread_mutex_unlock(&udev->mtx);
+}
+
+static void
+usb_dev_unref(struct usb_dev *udev)
+{
+	int refcnt;
+
+	pthread_mutex_lock(&udev->mtx);
+	refcnt = --udev->refcnt;
+	pthread_mutex_unlock(&udev->mtx);
+
+	if (refcnt > 0)
+		return;
+
+	/* libusb20_dev_free() also closes the device. */
+	libusb20_dev_free(udev->pdev);
+	pthread_cond_destroy(&udev->cv);
+	pthread_mutex_destroy(&udev->mtx);
+	free(udev);
+}
+
+static void
+usb_set_protocol(struct hid_interface *hi)
+{
+	struct LIBUSB20_CONTROL_SETUP_DECODED req;
+	struct libusb20_device *pdev;
+	struct usb_hid_data *ud;
+	unsigned char buf[64];
+	uint16_t buflen;
+	int e;
+
+	ud = hi->ht_data;
+	assert(ud != NULL && ud->udev != NULL);
+	pdev = ud->udev->pdev;
+
+	/*
+	 * Make sure the interface is in report protocol mode. If it's set in
+	 * boot protocol mode, it's likely that the HID device will only output
+	 * standard(basic) reports that're understood by the BIOS. For example,
+	 * if a keyboard is set in boot protocol mode, it probably will disable
+	 * multimedia key report output on its second interface.
+	 *
+	 * Also note, according to the HID spec, only boot device support this
+	 * feature, so make sure we check the interface subclass before doing
+	 * requets.
+	 */
+	if (hi->isubclass != 1)
+		return;
+
+	LIBUSB20_INIT(LIBUSB20_CONTROL_SETUP, &req);
+	req.bmRequestType = LIBUSB20_ENDPOINT_IN |
+	    LIBUSB20_REQUEST_TYPE_CLASS | LIBUSB20_RECIPIENT_INTERFACE;
+	req.bRequest = 0x03; /* GET_PROTOCOL */
+	req.wValue = 0;
+	req.wIndex = hi->ndx;
+	req.wLength = 1;
+	e = libusb20_dev_request_sync(pdev, &req, buf, &buflen, 0, 0);
+	if (e) {
+		syslog(LOG_ERR, "%s[%d]=> libusb20_dev_request_sync"
+		    " failed", hi->dev, hi->ndx);
+		syslog(LOG_ERR, "%s[%d]=> GET_PROTOCOL failed",
+		    hi->dev, hi->ndx);
+		return;
+	}
+	if (buflen != 1) {
+		syslog(LOG_ERR, "%s[%d]=> GET_PROTOCOL failed: "
+		    "buflen != 1", hi->dev, hi->ndx);
+		return;
+	}
+	if (buf[0] == 1) {
+		PRINT1(1, "Interface is in Report Protocol Mode\n");
+		return;
+	}
+	if (buf[0] != 0) {
+		syslog(LOG_ERR, "%s[%d]=> GET_PROTOCOL failed: "
+		    "invalid data: %u", hi->dev, hi->ndx,
+		    (unsigned) buf[0]);
+		return;
+	}
+	PRINT1(0, "Interface is in Boot Protocol Mode, "
+	    "attempt to switch to Report Protocol Mode...\n");
+	LIBUSB20_INIT(LIBUSB20_CONTROL_SETUP, &req);
+	req.bmRequestType = LIBUSB20_ENDPOINT_OUT |
+	    LIBUSB20_REQUEST_TYPE_CLASS | LIBUSB20_RECIPIENT_INTERFACE;
+	req.bRequest = 0x0B; /* SET_PROTOCOL */
+	req.wValue = 1;
+	req.wIndex = hi->ndx;
+	req.wLength = 0;
+	e = libusb20_dev_request_sync(pdev, &req, NULL, NULL, 0, 0);
+	if (e) {
+		syslog(LOG_ERR, "%s[%d]=> libusb20_dev_request_sync"
+		    " failed", hi->dev, hi->ndx);
+		syslog(LOG_ERR, "%s[%d]=> SET_PROTOCOL failed",
+		    hi->dev, hi->ndx);
+		return;
+	}
+	PRINT1(0, "Interface SET_PROTOCOL ok.\n");
+}
+
+static int
+alloc_hid_interface_be(struct hid_interface *hi)
+{
+	struct usb_hid_data *ud;
+
+	assert(hi != NULL);
+	ud = hi->ht_data;
+
+	/* The shared device handle is opened by find_device(). */
+	assert(ud != NULL && ud->udev != NULL && ud->udev->pdev != NULL);
+
+	usb_set_protocol(hi);
+
+	return (0);
+}
+
+static int
+usb_kernel_driver_active(struct hid_interface *hi)
+{
+	struct usb_hid_data *ud;
+
+	ud = hi->ht_data;
+	assert(ud != NULL && ud->udev != NULL);
+
+	return (libusb20_dev_kernel_driver_active(ud->udev->pdev, hi->ndx) == 0);
+}
+
+static int
+usb_detach_kernel_driver(struct hid_interface *hi)
+{
+	struct usb_hid_data *ud;
+
+	ud = hi->ht_data;
+	assert(ud != NULL && ud->udev != NULL);
+
+	if (libusb20_dev_detach_kernel_driver(ud->udev->pdev, hi->ndx) != 0) {
+		PRINT1(0, "libusb20_dev_detach_kernel_driver failed\n");
+		return (-1);
+	}
+
+	return (0);
+}
+
+static int
+usb_start(struct hid_interface *hi)
+{
+	struct usb_hid_data *ud;
+	uint8_t x;
+	int e;
+
+	ud = hi->ht_data;
+	assert(ud != NULL && ud->udev != NULL);
+
+	x = (ud->ep & LIBUSB20_ENDPOINT_ADDRESS_MASK) * 2;
+	x |= 1;			/* IN transfer. */
+	pthread_mutex_lock(&ud->udev->mtx);
+	ud->xfer = libusb20_tr_get_pointer(ud->udev->pdev, x);
+	if (ud->xfer == NULL) {
+		pthread_mutex_unlock(&ud->udev->mtx);
+		syslog(LOG_ERR, "%s[%d] libusb20_tr_get_pointer failed\n",
+		    hi->dev, hi->ndx);
+		return (-1);
+	}
+
+	e = libusb20_tr_open(ud->xfer, _TR_BUFSIZE, 1, ud->ep);
+	pthread_mutex_unlock(&ud->udev->mtx);
+	if (e == LIBUSB20_ERROR_BUSY) {
+		PRINT1(0, "xfer already opened\n");
+	} else if (e) {
+		syslog(LOG_ERR, "%s[%d] libusb20_tr_open failed\n",
+		    hi->dev, hi->ndx);
+		ud->xfer = NULL;
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Wait for the transfer to complete, leading the event processing on
+ * the shared handle if no other thread is. Called with udev->mtx held.
+ */
+static int
+usb_xfer_wait(struct usb_dev *udev, struct libusb20_transfer *xfer)
+{
+	int e;
+
+	e = 0;
+	while (libusb20_tr_pending(xfer)) {
+		if (udev->leader) {
+			pthread_cond_wait(&udev->cv, &udev->mtx);
+			continue;
+		}
+		udev->leader = 1;
+		pthread_mutex_unlock(&udev->mtx);
+		libusb20_dev_wait_process(udev->pdev, -1);
+		pthread_mutex_lock(&udev->mtx);
+		udev->leader = 0;
+		e = libusb20_dev_process(udev->pdev);
+		pthread_cond_broadcast(&udev->cv);
+		if (e != 0)
+			break;
+	}
+
+	return (e);
+}
+
+static int
+usb_read(struct hid_interface *hi, struct hid_xfer_batch *xb)
+{
+	struct usb_hid_data *ud;
+	struct usb_dev *udev;
+	struct hid_xfer *hx;
+	int e;
+
+	ud = hi->ht_data;
+	assert(ud != NULL && ud->xfer != NULL);
+	udev = ud->udev;
+
+	hx = &xb->xb_xfer[0];
+	hx->hx_data = xb->xb_buf;
+
+	pthread_mutex_lock(&udev->mtx);
+
+	/*
+	 * A transfer left pending by a failed read must complete before
+	 * the transfer can be set up again.
+	 */
+	if ((e = usb_xfer_wait(udev, ud->xfer)) == 0) {
+		libusb20_tr_setup_intr(ud->xfer, hx->hx_data, hi->pkt_sz, 0);
+		libusb20_tr_start(ud->xfer);
+		e = usb_xfer_wait(udev, ud->xfer);
+	}
+
+	pthread_mutex_unlock(&udev->mtx);
+
+	if (e != 0)
+		return (-1);
+
+	clock_gettime(CLOCK_MONOTONIC, &hx->hx_ts);
+
+	switch (libusb20_tr_get_status(ud->xfer)) {
+	case 0:
+		hx->hx_status = HID_XFER_OK;
+		hx->hx_len = libusb20_tr_get_actual_length(ud->xfer);
+		break;
+	case LIBUSB20_TRANSFER_TIMED_OUT:
+		hx->hx_status = HID_XFER_TIMEDOUT;
+		hx->hx_len = 0;
+		break;
+	default:
+		hx->hx_status = HID_XFER_ERROR;
+		hx->hx_len = 0;
+		break;
+	}
+
+	return (1);
+}
+
+static void
+usb_close(struct hid_interface *hi)
+{
+	struct usb_hid_data *ud;
+
+	pthread_mutex_lock(&usb_data_mtx);
+	ud = hi->ht_data;
+	hi->ht_data = NULL;
+	pthread_mutex_unlock(&usb_data_mtx);
+	assert(ud != NULL && ud->udev != NULL);
+
+	if (ud->xfer != NULL) {
+		pthread_mutex_lock(&ud->udev->mtx);
+		libusb20_tr_close(ud->xfer);
+		pthread_mutex_unlock(&ud->udev->mtx);
+	}
+	usb_dev_unref(ud->udev);
+	free(ud);
+}
+
+#define	_SET_REPORT_RETRY	3
+
+static int
+usb_set_report(struct hid_interface *hi, int type, int report_id, char *buf,
+    int len)
+{
+	struct LIBUSB20_CONTROL_SETUP_DECODED req;
+	struct usb_hid_data *ud;
+	struct usb_dev *udev;
+	uint16_t actlen;
+	int e, try;
+
+	/*
+	 * The interface may already be closed, e.g. on device detach.
+	 * Otherwise hold a reference so the handle outlives a concurrent
+	 * usb_close() for the duration of the control transfer.
+	 */
+	pthread_mutex_lock(&usb_data_mtx);
+	if ((ud = hi->ht_data) == NULL) {
+		pthread_mutex_unlock(&usb_data_mtx);
+		return (-1);
+	}
+	udev = ud->udev;
+	usb_dev_ref(udev);
+	pthread_mutex_unlock(&usb_data_mtx);
+
+	LIBUSB20_INIT(LIBUSB20_CONTROL_SETUP, &req);
+	req.bmRequestType = LIBUSB20_ENDPOINT_OUT |
+	    LIBUSB20_REQUEST_TYPE_CLASS | LIBUSB20_RECIPIENT_INTERFACE;
+	req.bRequest = 0x09;	/* SET_REPORT */
+	req.wValue = (type << 8) | (report_id & 0xff);
+	req.wIndex = hi->ndx;
+	req.wLength = len;
+	try = 0;
+	do {
+		e = libusb20_dev_request_sync(udev->pdev, &req, buf, &actlen,
+		    0, 0);
+		if (e && verbose)
+			syslog(LOG_ERR, "%s[%d] libusb20_dev_request_sync "
+			    "failed", hi->dev, hi->ndx);
+		try++;
+	} while (e && try < _SET_REPORT_RETRY);
+	usb_dev_unref(udev);
+	if (e) {
+		syslog(LOG_ERR, "%s[%d] libusb20_dev_request_sync failed",
+		    hi->dev, hi->ndx);
+		return (-1);
+	}
+
+	return (0);
+}
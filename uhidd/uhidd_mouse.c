@@ -52,8 +52,12 @@ __FBSDID("$FreeBSD$");
 struct mouse_dev {
 	struct hid_appcol *ha;
 	int cons_fd;
+	int pending;
+	struct mouse_info pmi;
 };
 
+static void	mouse_submit(struct mouse_dev *md);
+
 int
 mouse_match(struct hid_appcol *ha)
 {
@@ -197,7 +201,6 @@ mouse_recv(struct hid_appcol *ha, struct hid_report *hr)
 			btn |= (1 << 9);
 	}
 
-	/* Push the data to console device. (and sysmouse) */
 	mi.operation = MOUSE_ACTION;
 	mi.u.data.x = dx;
 	mi.u.data.y = dy;
@@ -211,7 +214,47 @@ mouse_recv(struct hid_appcol *ha, struct hid_report *hr)
 	else
 		mi.u.data.z = 0;
 
-	if (ioctl(md->cons_fd, CONS_MOUSECTL, &mi) < 0)
+	/*
+	 * Coalesce the motion of the reports received in one wakeup,
+	 * as long as the button state doesn't change.
+	 */
+	if (md->pending && md->pmi.u.data.buttons != mi.u.data.buttons)
+		mouse_submit(md);
+	if (md->pending) {
+		md->pmi.u.data.x += mi.u.data.x;
+		md->pmi.u.data.y += mi.u.data.y;
+		md->pmi.u.data.z += mi.u.data.z;
+	} else {
+		md->pmi = mi;
+		md->pending = 1;
+	}
+}
+
+int
+mouse_flush(struct hid_appcol *ha)
+{
+	struct mouse_dev *md;
+
+	md = hid_appcol_get_private(ha);
+	assert(md != NULL);
+
+	if (md->pending)
+		mouse_submit(md);
+
+	return (0);
+}
+
+static void
+mouse_submit(struct mouse_dev *md)
+{
+	struct hid_interface *hi;
+
+	hi = hid_appcol_get_parser_private(md->ha);
+	assert(hi != NULL);
+
+	/* Push the data to console device. (and sysmouse) */
+	if (ioctl(md->cons_fd, CONS_MOUSECTL, &md->pmi) < 0)
 		syslog(LOG_ERR, "%s[%d] could not submit mouse data:"
 		    " ioctl failed: %m", hi->dev, hi->ndx);
+	md->pending = 0;
 }
@@ -0,0 +1,517 @@
+/*-
+ * Copyright (c) 2015 Kai Wang
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * HID report capture and replay.
+ *
+ * The capture file starts with an 8-byte magic and a 16-bit version,
+ * followed by a stream of records. Each record has a 12-byte header:
+ *
+ *	uint8_t		type	(REC_DESC or REC_REPORT)
+ *	uint8_t		ndx	interface index
+ *	uint16_t	len	payload length
+ *	uint64_t	ts	nanoseconds since capture start
+ *
+ * A REC_DESC payload is vendor id, product id, packet size (16 bits
+ * each), interface class, subclass, protocol and endpoint bInterval,
+ * followed by the report descriptor. A REC_REPORT payload is the raw
+ * report. All integers are little-endian.
+ *
+ * The replay transport reads a capture file back and feeds the reports
+ * through the normal parser and drivers, either at the original pace
+ * or as fast as possible, and prints throughput and latency figures
+ * once the dispatch side has processed them all. The transport waits
+ * for room in the report ring rather than drop reports, so even a fast
+ * replay processes every report. No USB hardware is needed.
+ */
+
+#include <sys/cdefs.h>
+__FBSDID("$FreeBSD$");
+
+#include <sys/param.h>
+#include <sys/stat.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include "uhidd.h"
+
+#define	CAP_MAGIC	"UHIDDCAP"
+#define	CAP_MAGIC_SZ	8
+#define	CAP_VERSION	1
+#define	CAP_FILEHDR_SZ	(CAP_MAGIC_SZ + 2)
+#define	CAP_RECHDR_SZ	12
+#define	CAP_DESCHDR_SZ	10
+
+#define	REC_DESC	1
+#define	REC_REPORT	2
+
+struct replay_rec {
+	uint64_t	 ts;
+	int		 ndx;
+	int		 len;
+	unsigned char	*data;
+};
+
+struct replay_data {
+	int		 pos;
+	uint64_t	 nrep;
+	uint64_t	 lag_sum;
+	uint64_t	 lag_max;
+	struct timespec	 first;
+};
+
+static FILE *cap_fp = NULL;
+static struct timespec cap_start;
+
+static const char *replay_path = NULL;
+static int replay_fast = 0;
+static unsigned char *replay_buf = NULL;
+static struct replay_rec *replay_recs = NULL;
+static int replay_nrec = 0;
+static struct timespec replay_start;
+static int replay_started = 0;
+static pthread_mutex_t replay_mtx = PTHREAD_MUTEX_INITIALIZER;
+
+static int	replay_match(const char *dev);
+static int	replay_enumerate(const char *dev);
+static int	replay_open(struct hid_interface *hi);
+static int	replay_read(struct hid_interface *hi,
+		    struct hid_xfer_batch *xb);
+static void	replay_close(struct hid_interface *hi);
+static int	replay_set_report(struct hid_interface *hi, int type,
+		    int report_id, char *buf, int len);
+
+struct hid_transport replay_transport = {
+	.ht_name = "replay",
+	.ht_match = replay_match,
+	.ht_enumerate = replay_enumerate,
+	.ht_open = replay_open,
+	.ht_start = NULL,
+	.ht_read = replay_read,
+	.ht_close = replay_close,
+	.ht_set_report = replay_set_report,
+	.ht_kernel_driver_active = NULL,
+	.ht_detach_kernel_driver = NULL,
+	.ht_backpressure = 1,
+};
+
+static void
+put16(unsigned char *p, uint16_t v)
+{
+
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+static void
+put64(unsigned char *p, uint64_t v)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		p[i] = (v >> (i * 8)) & 0xff;
+}
+
+static uint16_t
+get16(const unsigned char *p)
+{
+
+	return (p[0] | (p[1] << 8));
+}
+
+static uint64_t
+get64(const unsigned char *p)
+{
+	uint64_t v;
+	int i;
+
+	v = 0;
+	for (i = 0; i < 8; i++)
+		v |= (uint64_t) p[i] << (i * 8);
+
+	return (v);
+}
+
+static uint64_t
+ts_diff(const struct timespec *a, const struct timespec *b)
+{
+	int64_t d;
+
+	d = (int64_t) (a->tv_sec - b->tv_sec) * 1000000000 +
+	    (a->tv_nsec - b->tv_nsec);
+
+	return (d > 0 ? (uint64_t) d : 0);
+}
+
+/*
+ * Capture.
+ */
+
+int
+capture_open(const char *path)
+{
+	unsigned char hdr[CAP_FILEHDR_SZ];
+
+	if ((cap_fp = fopen(path, "w")) == NULL) {
+		syslog(LOG_ERR, "fopen %s failed: %m", path);
+		return (-1);
+	}
+	memcpy(hdr, CAP_MAGIC, CAP_MAGIC_SZ);
+	put16(hdr + CAP_MAGIC_SZ, CAP_VERSION);
+	if (fwrite(hdr, sizeof(hdr), 1, cap_fp) != 1) {
+		syslog(LOG_ERR, "write %s failed: %m", path);
+		fclose(cap_fp);
+		cap_fp = NULL;
+		return (-1);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &cap_start);
+
+	return (0);
+}
+
+static void
+capture_write(int type, int ndx, const struct timespec *ts,
+    const unsigned char *hdr, int hsz, const void *data, int len)
+{
+	unsigned char buf[CAP_RECHDR_SZ + CAP_DESCHDR_SZ + _MAX_RDESC_SIZE];
+
+	assert(hsz + len <= CAP_DESCHDR_SZ + _MAX_RDESC_SIZE);
+
+	buf[0] = type;
+	buf[1] = ndx;
+	put16(buf + 2, hsz + len);
+	put64(buf + 4, ts_diff(ts, &cap_start));
+	if (hsz > 0)
+		memcpy(buf + CAP_RECHDR_SZ, hdr, hsz);
+	memcpy(buf + CAP_RECHDR_SZ + hsz, data, len);
+
+	/* One fwrite per record, so records from interfaces don't mix. */
+	fwrite(buf, CAP_RECHDR_SZ + hsz + len, 1, cap_fp);
+}
+
+void
+capture_write_desc(struct hid_interface *hi)
+{
+	unsigned char hdr[CAP_DESCHDR_SZ];
+
+	if (cap_fp == NULL)
+		return;
+
+	put16(hdr, hi->vendor_id);
+	put16(hdr + 2, hi->product_id);
+	put16(hdr + 4, hi->pkt_sz);
+	hdr[6] = hi->iclass;
+	hdr[7] = hi->isubclass;
+	hdr[8] = hi->iproto;
+	hdr[9] = hi->binterval;
+	capture_write(REC_DESC, hi->ndx, &cap_start, hdr, sizeof(hdr),
+	    hi->rdesc, hi->rsz);
+}
+
+void
+capture_write_report(struct hid_interface *hi, struct hid_xfer *hx)
+{
+
+	if (cap_fp == NULL || hx->hx_len <= 0 || hx->hx_len > _TR_BUFSIZE)
+		return;
+
+	capture_write(REC_REPORT, hi->ndx, &hx->hx_ts, NULL, 0, hx->hx_data,
+	    hx->hx_len);
+}
+
+/*
+ * Replay transport.
+ */
+
+void
+replay_init(const char *path, int fast)
+{
+
+	replay_path = path;
+	replay_fast = fast;
+}
+
+static int
+replay_match(const char *dev)
+{
+
+	(void) dev;
+
+	return (replay_path != NULL);
+}
+
+static int
+replay_load(void)
+{
+	struct stat sb;
+	unsigned char *p, *end;
+	int fd, len, n;
+
+	if ((fd = open(replay_path, O_RDONLY)) < 0) {
+		syslog(LOG_ERR, "open %s failed: %m", replay_path);
+		return (-1);
+	}
+	if (fstat(fd, &sb) < 0 || sb.st_size < CAP_FILEHDR_SZ) {
+		syslog(LOG_ERR, "%s: not a capture file", replay_path);
+		close(fd);
+		return (-1);
+	}
+	if ((replay_buf = malloc(sb.st_size)) == NULL) {
+		syslog(LOG_ERR, "malloc failed: %m");
+		close(fd);
+		return (-1);
+	}
+	for (n = 0; n < sb.st_size; n += len) {
+		if ((len = read(fd, replay_buf + n, sb.st_size - n)) <= 0) {
+			syslog(LOG_ERR, "read %s failed: %m", replay_path);
+			close(fd);
+			return (-1);
+		}
+	}
+	close(fd);
+
+	if (memcmp(replay_buf, CAP_MAGIC, CAP_MAGIC_SZ) != 0 ||
+	    get16(replay_buf + CAP_MAGIC_SZ) != CAP_VERSION) {
+		syslog(LOG_ERR, "%s: bad capture file magic or version",
+		    replay_path);
+		return (-1);
+	}
+
+	/* Count the records first, then index them. */
+	end = replay_buf + sb.st_size;
+	for (n = 0; n < 2; n++) {
+		replay_nrec = 0;
+		p = replay_buf + CAP_FILEHDR_SZ;
+		while (p + CAP_RECHDR_SZ <= end) {
+			len = get16(p + 2);
+			if (p + CAP_RECHDR_SZ + len > end) {
+				syslog(LOG_WARNING, "%s: truncated record",
+				    replay_path);
+				break;
+			}
+			if (replay_recs != NULL) {
+				replay_recs[replay_nrec].ts = get64(p + 4);
+				replay_recs[replay_nrec].ndx = p[1];
+				replay_recs[replay_nrec].len = len;
+				replay_recs[replay_nrec].data =
+				    p + CAP_RECHDR_SZ;
+				if (p[0] == REC_DESC)
+					replay_recs[replay_nrec].len = -len;
+			}
+			replay_nrec++;
+			p += CAP_RECHDR_SZ + len;
+		}
+		if (replay_recs == NULL &&
+		    (replay_recs = calloc(replay_nrec + 1,
+		    sizeof(*replay_recs))) == NULL) {
+			syslog(LOG_ERR, "calloc failed: %m");
+			return (-1);
+		}
+	}
+
+	return (0);
+}
+
+static int
+replay_enumerate(const char *dev)
+{
+	struct hid_interface *hi;
+	struct replay_data *rd;
+	struct replay_rec *rr;
+	int i, len;
+
+	if (replay_load() < 0)
+		return (-1);
+
+	/* Negative length marks a descriptor record. */
+	for (i = 0; i < replay_nrec; i++) {
+		rr = &replay_recs[i];
+		if (rr->len >= 0)
+			continue;
+		len = -rr->len - CAP_DESCHDR_SZ;
+		if (len <= 0 || len > _MAX_RDESC_SIZE) {
+			syslog(LOG_ERR, "%s: bad descriptor record",
+			    replay_path);
+			return (-1);
+		}
+		if ((rd = calloc(1, sizeof(*rd))) == NULL) {
+			syslog(LOG_ERR, "calloc failed: %m");
+			exit(1);
+		}
+		hi = hid_interface_alloc(dev, rr->ndx);
+		hi->ht = &replay_transport;
+		hi->ht_data = rd;
+		hi->vendor_id = get16(rr->data);
+		hi->product_id = get16(rr->data + 2);
+		hi->pkt_sz = get16(rr->data + 4);
+		hi->iclass = rr->data[6];
+		hi->isubclass = rr->data[7];
+		hi->iproto = rr->data[8];
+		hi->binterval = rr->data[9];
+		memcpy(hi->rdesc, rr->data + CAP_DESCHDR_SZ, len);
+		hi->rsz = len;
+		PRINT1(1, "replay interface vendor %#06x product %#06x "
+		    "rdesc size %d\n", hi->vendor_id, hi->product_id,
+		    hi->rsz);
+		hid_interface_register(hi);
+	}
+
+	return (0);
+}
+
+static int
+replay_open(struct hid_interface *hi)
+{
+
+	(void) hi;
+
+	return (0);
+}
+
+/*
+ * Called once the reports read are all processed. The throughput is
+ * that of the dispatch side, from the first report fed to the end of
+ * the processing of the last one; the latency is from the time a
+ * report is fed to the end of its processing.
+ */
+void
+replay_report(struct hid_interface *hi)
+{
+	struct replay_data *rd;
+	struct hid_stats *st;
+	uint64_t elapsed, rate;
+
+	rd = hi->ht_data;
+	st = &hi->stats;
+	if (rd == NULL || rd->nrep == 0 || st->st_done == 0) {
+		PRINT1(0, "replay: no reports\n");
+		return;
+	}
+
+	elapsed = ts_diff(&st->st_done_last, &rd->first);
+	rate = elapsed > 0 ? st->st_done * 1000000000 / elapsed : 0;
+	PRINT1(0, "replay: %ju of %ju reports processed in %ju.%06ju s "
+	    "(%ju reports/s)\n", (uintmax_t) st->st_done,
+	    (uintmax_t) rd->nrep, (uintmax_t) (elapsed / 1000000000),
+	    (uintmax_t) (elapsed % 1000000000) / 1000, (uintmax_t) rate);
+	PRINT1(0, "replay: latency avg %ju ns max %ju ns\n",
+	    (uintmax_t) (st->st_lat_sum / st->st_done),
+	    (uintmax_t) st->st_lat_max);
+	if (!replay_fast)
+		PRINT1(0, "replay: delivery lag avg %ju ns max %ju ns\n",
+		    (uintmax_t) (rd->lag_sum / rd->nrep),
+		    (uintmax_t) rd->lag_max);
+}
+
+static int
+replay_read(struct hid_interface *hi, struct hid_xfer_batch *xb)
+{
+	struct replay_data *rd;
+	struct replay_rec *rr;
+	struct hid_xfer *hx;
+	struct timespec now, due;
+	uint64_t d;
+
+	rd = hi->ht_data;
+	assert(rd != NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	pthread_mutex_lock(&replay_mtx);
+	if (!replay_started) {
+		replay_start = now;
+		replay_started = 1;
+	}
+	pthread_mutex_unlock(&replay_mtx);
+
+	for (; rd->pos < replay_nrec; rd->pos++) {
+		rr = &replay_recs[rd->pos];
+		if (rr->ndx == hi->ndx && rr->len > 0)
+			break;
+	}
+	if (rd->pos >= replay_nrec)
+		return (-1);
+	rr = &replay_recs[rd->pos++];
+
+	if (!replay_fast) {
+		due.tv_sec = replay_start.tv_sec + rr->ts / 1000000000;
+		due.tv_nsec = replay_start.tv_nsec + rr->ts % 1000000000;
+		if (due.tv_nsec >= 1000000000) {
+			due.tv_sec++;
+			due.tv_nsec -= 1000000000;
+		}
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due,
+		    NULL) == EINTR)
+			;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		d = ts_diff(&now, &due);
+		rd->lag_sum += d;
+		if (d > rd->lag_max)
+			rd->lag_max = d;
+	}
+
+	hx = &xb->xb_xfer[0];
+	hx->hx_status = HID_XFER_OK;
+	hx->hx_len = MIN(rr->len, _TR_BUFSIZE);
+	hx->hx_data = xb->xb_buf;
+	hx->hx_ts = now;
+	memcpy(hx->hx_data, rr->data, hx->hx_len);
+
+	if (rd->nrep == 0)
+		rd->first = now;
+	rd->nrep++;
+
+	return (1);
+}
+
+static void
+replay_close(struct hid_interface *hi)
+{
+
+	free(hi->ht_data);
+	hi->ht_data = NULL;
+}
+
+static int
+replay_set_report(struct hid_interface *hi, int type, int report_id,
+    char *buf, int len)
+{
+
+	(void) type; (void) buf; (void) len;
+
+	PRINT1(2, "replay: discard output report id(%d)\n", report_id);
+
+	return (0);
+}
@@ -0,0 +1,242 @@
+/*-
+ * Copyright (c) 2015 Kai Wang
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Single-producer/single-consumer report ring.
+ *
+ * The interface thread copies the reports it receives into the ring
+ * and goes straight back to reading the device, while the dispatch
+ * thread takes them out and runs the parser and the drivers. The ring
+ * indices are only ever advanced by their owner, so no lock is needed;
+ * the semaphores are only used to put the dispatch thread to sleep when
+ * the ring is empty, and a transport which can wait (the replay) to
+ * sleep when it is full.
+ */
+
+#include <sys/cdefs.h>
+__FBSDID("$FreeBSD$");
+
+#include <sys/param.h>
+#include <assert.h>
+#include <errno.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include "uhidd.h"
+
+struct hid_ring_slot {
+	int		 rs_len;
+	struct timespec	 rs_ts;
+	char		*rs_data;
+};
+
+struct hid_ring {
+	atomic_uint		 hr_head;	/* Advanced by the consumer. */
+	atomic_uint		 hr_tail;	/* Advanced by the producer. */
+	atomic_int		 hr_closed;
+	atomic_int		 hr_waiting;	/* Producer waits for room. */
+	atomic_int		 hr_notify;	/* See hid_ring_notify(). */
+	unsigned		 hr_size;
+	int			 hr_slot_sz;
+	sem_t			 hr_sem;
+	sem_t			 hr_space;
+	char			*hr_buf;
+	struct hid_ring_slot	*hr_slot;
+};
+
+struct hid_ring *
+hid_ring_alloc(int nslot, int slot_sz)
+{
+	struct hid_ring *hr;
+	int i;
+
+	/* The ring size must be a power of two. */
+	assert(nslot > 0 && (nslot & (nslot - 1)) == 0);
+
+	if ((hr = calloc(1, sizeof(*hr))) == NULL ||
+	    (hr->hr_slot = calloc(nslot, sizeof(*hr->hr_slot))) == NULL ||
+	    (hr->hr_buf = malloc((size_t) nslot * slot_sz)) == NULL) {
+		syslog(LOG_ERR, "calloc failed: %m");
+		exit(1);
+	}
+	for (i = 0; i < nslot; i++)
+		hr->hr_slot[i].rs_data = hr->hr_buf + i * slot_sz;
+	hr->hr_size = nslot;
+	hr->hr_slot_sz = slot_sz;
+	atomic_init(&hr->hr_head, 0);
+	atomic_init(&hr->hr_tail, 0);
+	atomic_init(&hr->hr_closed, 0);
+	atomic_init(&hr->hr_waiting, 0);
+	atomic_init(&hr->hr_notify, 0);
+	if (sem_init(&hr->hr_sem, 0, 0) < 0 ||
+	    sem_init(&hr->hr_space, 0, 0) < 0) {
+		syslog(LOG_ERR, "sem_init failed: %m");
+		exit(1);
+	}
+
+	return (hr);
+}
+
+void
+hid_ring_free(struct hid_ring *hr)
+{
+
+	sem_destroy(&hr->hr_sem);
+	sem_destroy(&hr->hr_space);
+	free(hr->hr_buf);
+	free(hr->hr_slot);
+	free(hr);
+}
+
+/*
+ * Producer side. Returns -1 if the ring is full, the report is dropped.
+ */
+int
+hid_ring_put(struct hid_ring *hr, struct hid_xfer *hx)
+{
+	struct hid_ring_slot *rs;
+	unsigned head, tail;
+
+	tail = atomic_load_explicit(&hr->hr_tail, memory_order_relaxed);
+	head = atomic_load_explicit(&hr->hr_head, memory_order_acquire);
+	if (tail - head >= hr->hr_size)
+		return (-1);
+
+	rs = &hr->hr_slot[tail & (hr->hr_size - 1)];
+	rs->rs_len = MIN(hx->hx_len, hr->hr_slot_sz);
+	rs->rs_ts = hx->hx_ts;
+	memcpy(rs->rs_data, hx->hx_data, rs->rs_len);
+	atomic_store_explicit(&hr->hr_tail, tail + 1, memory_order_release);
+
+	return (0);
+}
+
+/*
+ * Producer side. Wakeup the consumer after a batch of hid_ring_put().
+ */
+void
+hid_ring_kick(struct hid_ring *hr)
+{
+
+	sem_post(&hr->hr_sem);
+}
+
+/*
+ * Producer side. Sleep until the consumer frees a slot, after
+ * hid_ring_put() found the ring full and the consumer was kicked. The
+ * wakeup may be stale, so the caller retries hid_ring_put().
+ */
+void
+hid_ring_wait(struct hid_ring *hr)
+{
+	unsigned head, tail;
+
+	/* Paired with the fence in hid_ring_get(). */
+	atomic_store_explicit(&hr->hr_waiting, 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	tail = atomic_load_explicit(&hr->hr_tail, memory_order_relaxed);
+	head = atomic_load_explicit(&hr->hr_head, memory_order_relaxed);
+	if (tail - head >= hr->hr_size) {
+		while (sem_wait(&hr->hr_space) < 0 && errno == EINTR)
+			;
+	}
+	atomic_store_explicit(&hr->hr_waiting, 0, memory_order_relaxed);
+}
+
+/*
+ * Producer side. No more reports will be put into the ring.
+ */
+void
+hid_ring_close(struct hid_ring *hr)
+{
+
+	atomic_store_explicit(&hr->hr_closed, 1, memory_order_release);
+	sem_post(&hr->hr_sem);
+}
+
+/*
+ * Any thread. Wakeup the consumer even though there is no report, for
+ * work which other threads hand to the consumer (e.g. the LED output
+ * reports of kbd).
+ */
+void
+hid_ring_notify(struct hid_ring *hr)
+{
+
+	atomic_store_explicit(&hr->hr_notify, 1, memory_order_release);
+	sem_post(&hr->hr_sem);
+}
+
+/*
+ * Consumer side. Wait for reports and copy up to xb_max of them into
+ * the batch. Returns the number of reports, 0 if woken up by
+ * hid_ring_notify() while the ring is empty, or -1 if the ring is
+ * closed and drained.
+ */
+int
+hid_ring_get(struct hid_ring *hr, struct hid_xfer_batch *xb)
+{
+	struct hid_ring_slot *rs;
+	struct hid_xfer *hx;
+	unsigned head, tail;
+	int closed, n;
+
+	head = atomic_load_explicit(&hr->hr_head, memory_order_relaxed);
+	for (;;) {
+		closed = atomic_load_explicit(&hr->hr_closed,
+		    memory_order_acquire);
+		tail = atomic_load_explicit(&hr->hr_tail,
+		    memory_order_acquire);
+		if (tail != head)
+			break;
+		if (closed)
+			return (-1);
+		if (atomic_exchange_explicit(&hr->hr_notify, 0,
+		    memory_order_acquire))
+			return (0);
+		while (sem_wait(&hr->hr_sem) < 0 && errno == EINTR)
+			;
+	}
+
+	for (n = 0; n < xb->xb_max && head != tail; n++, head++) {
+		rs = &hr->hr_slot[head & (hr->hr_size - 1)];
+		hx = &xb->xb_xfer[n];
+		hx->hx_status = HID_XFER_OK;
+		hx->hx_len = rs->rs_len;
+		hx->hx_ts = rs->rs_ts;
+		hx->hx_data = xb->xb_buf + n * _TR_BUFSIZE;
+		memcpy(hx->hx_data, rs->rs_data, rs->rs_len);
+	}
+	atomic_store_explicit(&hr->hr_head, head, memory_order_release);
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&hr->hr_waiting, memory_order_relaxed))
+		sem_post(&hr->hr_space);
+
+	return (n);
+}
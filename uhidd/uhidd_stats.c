@@ -0,0 +1,250 @@
+/*-
+ * Copyright (c) 2015 Kai Wang
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+#include <sys/cdefs.h>
+__FBSDID("$FreeBSD$");
+
+#include <sys/param.h>
+#include <sys/time.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "uhidd.h"
+
+/*
+ * Intervals longer than this are idle periods rather than polling
+ * intervals, and are left out of the average and the jitter.
+ */
+#define	STATS_IDLE_NS	100000000
+
+static uint64_t
+stats_ns(struct timespec *a, struct timespec *b)
+{
+	int64_t d;
+
+	d = (int64_t) (a->tv_sec - b->tv_sec) * 1000000000 +
+	    (a->tv_nsec - b->tv_nsec);
+
+	return (d > 0 ? (uint64_t) d : 0);
+}
+
+static int
+stats_bucket(uint64_t ns, uint64_t base)
+{
+	int i;
+
+	for (i = 0; i < _STATS_NBUCKET - 1 && ns >= base; i++)
+		base <<= 1;
+
+	return (i);
+}
+
+static void
+stats_add(uint64_t *hist, uint64_t *cnt, uint64_t ns, uint64_t base)
+{
+	int i;
+
+	hist[stats_bucket(ns, base)]++;
+
+	if (++(*cnt) >= _STATS_WINDOW) {
+		*cnt = 0;
+		for (i = 0; i < _STATS_NBUCKET; i++) {
+			hist[i] >>= 1;
+			*cnt += hist[i];
+		}
+	}
+}
+
+void
+hid_stats_xfer(struct hid_interface *hi, struct hid_xfer *hx)
+{
+	struct hid_stats *st;
+	uint64_t d, intvl;
+
+	st = &hi->stats;
+
+	switch (hx->hx_status) {
+	case HID_XFER_OK:
+		break;
+	case HID_XFER_TIMEDOUT:
+		st->st_timeouts++;
+		return;
+	default:
+		st->st_errors++;
+		return;
+	}
+
+	if (st->st_reports++ > 0) {
+		intvl = stats_ns(&hx->hx_ts, &st->st_last);
+		stats_add(st->st_intvl_hist, &st->st_intvl_cnt, intvl,
+		    _STATS_INTVL_BASE);
+		if (intvl < STATS_IDLE_NS) {
+			/* Smoothed like the RTP interarrival jitter. */
+			if (st->st_intvl_avg == 0)
+				st->st_intvl_avg = intvl;
+			else
+				st->st_intvl_avg = st->st_intvl_avg -
+				    st->st_intvl_avg / 16 + intvl / 16;
+			if (st->st_last_intvl > 0) {
+				d = intvl > st->st_last_intvl ?
+				    intvl - st->st_last_intvl :
+				    st->st_last_intvl - intvl;
+				st->st_jitter = st->st_jitter -
+				    st->st_jitter / 16 + d / 16;
+			}
+			st->st_last_intvl = intvl;
+		} else
+			st->st_last_intvl = 0;
+	}
+	st->st_last = hx->hx_ts;
+}
+
+void
+hid_stats_proc(struct hid_interface *hi, struct timespec *start,
+    struct timespec *end)
+{
+	struct hid_stats *st;
+	uint64_t ns;
+
+	st = &hi->stats;
+	ns = stats_ns(end, start);
+	if (ns > st->st_proc_max)
+		st->st_proc_max = ns;
+	stats_add(st->st_proc_hist, &st->st_proc_cnt, ns, _STATS_PROC_BASE);
+
+	/* From the arrival of the report to the end of its processing. */
+	ns = stats_ns(end, &hi->rx_ts);
+	st->st_lat_sum += ns;
+	if (ns > st->st_lat_max)
+		st->st_lat_max = ns;
+	st->st_done_last = *end;
+	st->st_done++;
+}
+
+static void
+stats_dump_hist(FILE *fp, const char *name, uint64_t *hist, uint64_t base)
+{
+	int i;
+
+	fprintf(fp, "\t%s:", name);
+	for (i = 0; i < _STATS_NBUCKET; i++, base <<= 1) {
+		if (hist[i] == 0)
+			continue;
+		if (i < _STATS_NBUCKET - 1)
+			fprintf(fp, " <%juus:%ju", (uintmax_t) base / 1000,
+			    (uintmax_t) hist[i]);
+		else
+			fprintf(fp, " >=%juus:%ju", (uintmax_t) base / 2000,
+			    (uintmax_t) hist[i]);
+	}
+	fputc('\n', fp);
+}
+
+void
+hid_stats_dump(struct hid_interface *hi, FILE *fp)
+{
+	struct hid_stats st;
+
+	/* Take a snapshot, the interface thread keeps updating. */
+	memcpy(&st, &hi->stats, sizeof(st));
+
+	fprintf(fp, "%s[%d]: vendor 0x%04x product 0x%04x bInterval %u "
+	    "packet size %d\n", hi->dev, hi->ndx, hi->vendor_id,
+	    hi->product_id, hi->binterval, hi->pkt_sz);
+	fprintf(fp, "\treports %ju timeouts %ju errors %ju overflows %ju\n",
+	    (uintmax_t) st.st_reports, (uintmax_t) st.st_timeouts,
+	    (uintmax_t) st.st_errors, (uintmax_t) st.st_overflows);
+	fprintf(fp, "\tinterval avg %juus jitter %juus\n",
+	    (uintmax_t) st.st_intvl_avg / 1000,
+	    (uintmax_t) st.st_jitter / 1000);
+	stats_dump_hist(fp, "interval", st.st_intvl_hist, _STATS_INTVL_BASE);
+	fprintf(fp, "\tprocess max %juus\n", (uintmax_t) st.st_proc_max / 1000);
+	if (st.st_done > 0)
+		fprintf(fp, "\tprocessed %ju latency avg %juus max %juus\n",
+		    (uintmax_t) st.st_done,
+		    (uintmax_t) (st.st_lat_sum / st.st_done) / 1000,
+		    (uintmax_t) st.st_lat_max / 1000);
+	stats_dump_hist(fp, "process", st.st_proc_hist, _STATS_PROC_BASE);
+	if (hi->hp != NULL)
+		hid_parser_stats(hi->hp, fp);
+}
+
+/*
+ * Convert a CLOCK_MONOTONIC time stamp to the time of day, for the
+ * evdev event time.
+ */
+void
+hid_stats_realtime(struct timespec *mono, struct timeval *tv)
+{
+	struct timespec now, rt;
+	uint64_t ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	clock_gettime(CLOCK_REALTIME, &rt);
+	ns = stats_ns(&now, mono);
+	ns = (uint64_t) rt.tv_sec * 1000000000 + rt.tv_nsec - ns;
+	tv->tv_sec = ns / 1000000000;
+	tv->tv_usec = ns % 1000000000 / 1000;
+}
+
+void
+hid_lathist_add(struct hid_lathist *lh, struct timespec *since)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	hid_lathist_add_ns(lh, stats_ns(&now, since));
+}
+
+void
+hid_lathist_add_ns(struct hid_lathist *lh, uint64_t ns)
+{
+	static atomic_int nthread;
+	static _Thread_local int slot = -1;
+
+	if (slot < 0)
+		slot = atomic_fetch_add(&nthread, 1) % _LAT_NSLOT;
+	atomic_fetch_add_explicit(
+	    &lh->lh_hist[slot][stats_bucket(ns, _STATS_LAT_BASE)], 1,
+	    memory_order_relaxed);
+}
+
+void
+hid_lathist_dump(struct hid_lathist *lh, FILE *fp, const char *name)
+{
+	uint64_t hist[_STATS_NBUCKET];
+	int i, j;
+
+	memset(hist, 0, sizeof(hist));
+	for (i = 0; i < _LAT_NSLOT; i++)
+		for (j = 0; j < _STATS_NBUCKET; j++)
+			hist[j] += atomic_load_explicit(&lh->lh_hist[i][j],
+			    memory_order_relaxed);
+	stats_dump_hist(fp, name, hist, _STATS_LAT_BASE);
+}
@@ -0,0 +1,312 @@
+/*-
+ * Copyright (c) 2015 Kai Wang
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/*
+ * Shared event loop: one-shot timers and file descriptor watches.
+ *
+ * All the timers of the daemon are kept on one list sorted by
+ * deadline, and are run by a single thread which sleeps in poll(2) on
+ * the watched descriptors until the earliest deadline. The thread
+ * doesn't wake up at all while nothing happens. Callbacks are called
+ * without the timer lock held, so they may rearm their timer.
+ */
+
+#include <sys/cdefs.h>
+__FBSDID("$FreeBSD$");
+
+#include <sys/param.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include "uhidd.h"
+
+#define	TIMER_NWATCH	64
+
+static TAILQ_HEAD(, hid_timer) timers = TAILQ_HEAD_INITIALIZER(timers);
+static TAILQ_HEAD(, hid_watch) watches = TAILQ_HEAD_INITIALIZER(watches);
+static int nwatch;
+static pthread_mutex_t timer_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t timer_once = PTHREAD_ONCE_INIT;
+static pthread_t timer_thread;
+static int timer_pipe[2];
+
+static void	timer_start(void);
+static void	timer_wakeup(void);
+static void	*timer_task(void *arg);
+static int	timer_before(struct timespec *a, struct timespec *b);
+
+void
+hid_timer_init(struct hid_timer *tm, void (*fn)(void *), void *arg)
+{
+
+	assert(fn != NULL);
+
+	tm->tm_fn = fn;
+	tm->tm_arg = arg;
+	tm->tm_armed = 0;
+	pthread_once(&timer_once, timer_start);
+}
+
+/*
+ * (Re)arm the timer to fire in ms milliseconds.
+ */
+void
+hid_timer_arm(struct hid_timer *tm, int ms)
+{
+	struct hid_timer *t;
+
+	pthread_mutex_lock(&timer_mtx);
+	if (tm->tm_armed)
+		TAILQ_REMOVE(&timers, tm, tm_next);
+	clock_gettime(CLOCK_MONOTONIC, &tm->tm_when);
+	if (ms > 0) {
+		tm->tm_when.tv_sec += ms / 1000;
+		tm->tm_when.tv_nsec += (long) (ms % 1000) * 1000000;
+		if (tm->tm_when.tv_nsec >= 1000000000) {
+			tm->tm_when.tv_sec++;
+			tm->tm_when.tv_nsec -= 1000000000;
+		}
+	}
+	TAILQ_FOREACH(t, &timers, tm_next) {
+		if (timer_before(&tm->tm_when, &t->tm_when))
+			break;
+	}
+	if (t != NULL)
+		TAILQ_INSERT_BEFORE(t, tm, tm_next);
+	else
+		TAILQ_INSERT_TAIL(&timers, tm, tm_next);
+	tm->tm_armed = 1;
+
+	/* The earliest deadline changed, let the timer thread know. */
+	if (TAILQ_FIRST(&timers) == tm)
+		timer_wakeup();
+	pthread_mutex_unlock(&timer_mtx);
+}
+
+/*
+ * Disarm the timer. Note that the callback may still run once if the
+ * timer is expiring concurrently.
+ */
+void
+hid_timer_disarm(struct hid_timer *tm)
+{
+
+	pthread_mutex_lock(&timer_mtx);
+	if (tm->tm_armed) {
+		TAILQ_REMOVE(&timers, tm, tm_next);
+		tm->tm_armed = 0;
+	}
+	pthread_mutex_unlock(&timer_mtx);
+}
+
+/*
+ * Call fn each time fd becomes readable. fn must read fd, or the loop
+ * spins.
+ */
+int
+hid_watch_add(struct hid_watch *hw, int fd, void (*fn)(void *), void *arg)
+{
+
+	assert(fd >= 0 && fn != NULL);
+
+	pthread_once(&timer_once, timer_start);
+	hw->hw_fd = fd;
+	hw->hw_fn = fn;
+	hw->hw_arg = arg;
+
+	pthread_mutex_lock(&timer_mtx);
+	if (nwatch >= TIMER_NWATCH) {
+		pthread_mutex_unlock(&timer_mtx);
+		syslog(LOG_ERR, "too many watched descriptors");
+		return (-1);
+	}
+	TAILQ_INSERT_TAIL(&watches, hw, hw_next);
+	hw->hw_active = 1;
+	nwatch++;
+	timer_wakeup();
+	pthread_mutex_unlock(&timer_mtx);
+
+	return (0);
+}
+
+/*
+ * Stop watching. May be called by the callback itself.
+ */
+void
+hid_watch_del(struct hid_watch *hw)
+{
+
+	pthread_mutex_lock(&timer_mtx);
+	if (hw->hw_active) {
+		TAILQ_REMOVE(&watches, hw, hw_next);
+		hw->hw_active = 0;
+		nwatch--;
+		timer_wakeup();
+	}
+	pthread_mutex_unlock(&timer_mtx);
+}
+
+/*
+ * Milliseconds on the monotonic clock, for deadlines which may wrap.
+ */
+uint32_t
+hid_timer_ms(void)
+{
+
+	return ((uint32_t) hid_timer_ms64());
+}
+
+/*
+ * Milliseconds on the monotonic clock, for timestamps which must not
+ * wrap.
+ */
+uint64_t
+hid_timer_ms64(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+static void
+timer_start(void)
+{
+
+	if (pipe(timer_pipe) < 0) {
+		syslog(LOG_ERR, "pipe failed: %m");
+		exit(1);
+	}
+	fcntl(timer_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(timer_pipe[1], F_SETFL, O_NONBLOCK);
+
+	if (pthread_create(&timer_thread, NULL, timer_task, NULL) != 0) {
+		syslog(LOG_ERR, "pthread_create failed: %m");
+		exit(1);
+	}
+}
+
+/*
+ * Interrupt the poll(2) of the timer thread, so that it picks up a new
+ * deadline or watch. Called with the timer lock held.
+ */
+static void
+timer_wakeup(void)
+{
+	char c;
+
+	c = 0;
+	(void) write(timer_pipe[1], &c, 1);
+}
+
+/* ARGSUSED */
+static void *
+timer_task(void *arg __unused)
+{
+	struct pollfd pfd[TIMER_NWATCH + 1];
+	struct hid_watch *hw, *hwl[TIMER_NWATCH + 1];
+	struct hid_timer *tm;
+	struct timespec now;
+	char buf[64];
+	int64_t ms;
+	int i, n, timo;
+
+	pthread_mutex_lock(&timer_mtx);
+	for (;;) {
+		timo = -1;
+		if ((tm = TAILQ_FIRST(&timers)) != NULL) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (!timer_before(&now, &tm->tm_when)) {
+				TAILQ_REMOVE(&timers, tm, tm_next);
+				tm->tm_armed = 0;
+				pthread_mutex_unlock(&timer_mtx);
+				tm->tm_fn(tm->tm_arg);
+				pthread_mutex_lock(&timer_mtx);
+				continue;
+			}
+			/* Round up, poll(2) must not return early. */
+			ms = (int64_t) (tm->tm_when.tv_sec - now.tv_sec) *
+			    1000 + (tm->tm_when.tv_nsec - now.tv_nsec +
+			    999999) / 1000000;
+			timo = (int) MIN(MAX(ms, 1), INT32_MAX);
+		}
+
+		pfd[0].fd = timer_pipe[0];
+		pfd[0].events = POLLIN;
+		n = 1;
+		TAILQ_FOREACH(hw, &watches, hw_next) {
+			pfd[n].fd = hw->hw_fd;
+			pfd[n].events = POLLIN;
+			hwl[n++] = hw;
+		}
+		pthread_mutex_unlock(&timer_mtx);
+
+		if (poll(pfd, n, timo) < 0 && errno != EINTR) {
+			syslog(LOG_ERR, "poll failed: %m");
+			exit(1);
+		}
+		if (pfd[0].revents & POLLIN)
+			while (read(timer_pipe[0], buf, sizeof(buf)) > 0)
+				;
+
+		pthread_mutex_lock(&timer_mtx);
+		for (i = 1; i < n; i++) {
+			if (pfd[i].revents == 0)
+				continue;
+			/* Skip the watches removed in the meantime. */
+			TAILQ_FOREACH(hw, &watches, hw_next)
+				if (hw == hwl[i])
+					break;
+			if (hw == NULL)
+				continue;
+			pthread_mutex_unlock(&timer_mtx);
+			hw->hw_fn(hw->hw_arg);
+			pthread_mutex_lock(&timer_mtx);
+		}
+	}
+
+	/* NOTREACHED */
+	return (NULL);
+}
+
+static int
+timer_before(struct timespec *a, struct timespec *b)
+{
+
+	if (a->tv_sec != b->tv_sec)
+		return (a->tv_sec < b->tv_sec);
+
+	return (a->tv_nsec < b->tv_nsec);
+}
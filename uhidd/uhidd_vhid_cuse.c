@@ -82,6 +82,7 @@ struct vhid_dev {
 	unsigned char	vd_rdesc[VHID_MAX_REPORT_DESC_SIZE];
 	uint16_t	vd_rsz;
 	int		vd_rid;
+	int		vd_pending;
 	pthread_mutex_t vd_mtx;
 	pthread_cond_t	vd_cv;
 };
@@ -239,14 +240,34 @@ vhid_recv_raw(struct hid_appcol *ha, uint8_t *buf, int len)
 		len--;
 	}
 
+	/* The reader is woken up by vhid_flush(). */
 	VHID_LOCK(vd);
 	rq_enqueue(&vd->vd_rq, buf, len);
+	vd->vd_pending = 1;
 	VHID_UNLOCK(vd);
+}
+
+int
+vhid_flush(struct hid_appcol *ha)
+{
+	struct vhid_dev *vd;
+	int pending;
+
+	vd = hid_appcol_get_private(ha);
+	assert(vd != NULL);
+
+	VHID_LOCK(vd);
+	pending = vd->vd_pending;
+	vd->vd_pending = 0;
+	VHID_UNLOCK(vd);
+
+	if (!pending)
+		return (0);
 
 	if (pthread_cond_signal(&vd->vd_cv) != 0)
-		syslog(LOG_ERR, "pthread_cond_signal failed in vhid_recv_raw");
+		syslog(LOG_ERR, "pthread_cond_signal failed in vhid_flush");
 
-	cuse_poll_wakeup();
+	return (1);
 }
 
 static void
@@ -0,0 +1,103 @@
+function num(s,    n, i) {
+    if (s !~ /^0[xX]/)
+	return (s + 0)
+    n = 0
+    for (i = 3; i <= length(s); i++)
+	n = n * 16 + index("0123456789abcdef", tolower(substr(s, i, 1))) - 1
+    return (n)
+}
+
+function addkey(s, u,    i) {
+    if (tolower(s) in seen)
+	return
+    seen[tolower(s)] = 1
+    # Insertion sort, the keys are compared the way strcasecmp(3) does.
+    for (i = nkey; i > 0 && tolower(key[i - 1]) > tolower(s); i--) {
+	key[i] = key[i - 1]
+	kusage[i] = kusage[i - 1]
+    }
+    key[i] = s
+    kusage[i] = u
+    nkey++
+}
+
+BEGIN {
+    printf("/* Generated by: awk -f usage_consumer.awk usb_hid_usages */\n\n");
+    printf("#include <stdlib.h>\n");
+    printf("#include <strings.h>\n\n");
+    printf("int usage_consumer_lookup(const char *name);\n\n");
+
+    # Names uhidd.conf(5) has always used for these usages, the
+    # usb_hid_usages spelling is accepted as well.
+    legacy[32] = "Plus_Ten"
+    legacy[33] = "Plus_Hundred"
+    legacy[418] = "AL_Select_Task/Application"
+    legacy[421] = "AL_Preemptive_Halt"
+    legacy[427] = "AL_Spell_Check"
+    legacy[445] = "AL_OEM_Features/_Tips/Tutorial_Browser"
+    legacy[598] = "AC_Indent_Decrease"
+    legacy[599] = "AC_Indent_Increase"
+    legacy[655] = "AC_Download"
+    legacy[667] = "AC_Disribute_Horizontally"
+
+    n = 0
+    nkey = 0
+}
+
+/^[0-9]/{
+    cons = (num($1) == 12)
+    next
+}
+
+cons && /^[[:space:]]/{
+    u = num($1)
+    s = substr($0, index($0, $2), length)
+    gsub(/ /, "_", s)
+    name[u] = s
+    if (u >= n)
+	n = u + 1
+}
+
+END {
+    printf("static const char *const _usage_consumer[%d] = {\n", n);
+    for (i = 0; i < n; i++) {
+	if (i in legacy)
+	    s = legacy[i]
+	else if (i in name)
+	    s = name[i]
+	else
+	    s = "Reserved"
+	printf("\t\"%s\",\n", s);
+	if (s != "Reserved")
+	    addkey(s, i)
+    }
+    printf("};\n\n");
+    for (i = 0; i < n; i++)
+	if ((i in legacy) && (i in name))
+	    addkey(name[i], i)
+
+    printf("int usage_consumer_num = %d;\n", n);
+    printf("const char *const *usage_consumer = _usage_consumer;\n\n");
+
+    printf("static const struct usage_key {\n");
+    printf("\tconst char *name;\n");
+    printf("\tint usage;\n");
+    printf("} usage_consumer_key[%d] = {\n", nkey);
+    for (i = 0; i < nkey; i++)
+	printf("\t{ \"%s\", 0x%x },\n", key[i], kusage[i]);
+    printf("};\n\n");
+
+    printf("static int\n");
+    printf("usage_key_cmp(const void *k, const void *e)\n");
+    printf("{\n\n");
+    printf("\treturn (strcasecmp(k, ((const struct usage_key *) e)->name));\n");
+    printf("}\n\n");
+    printf("int\n");
+    printf("usage_consumer_lookup(const char *name)\n");
+    printf("{\n");
+    printf("\tconst struct usage_key *e;\n\n");
+    printf("\te = bsearch(name, usage_consumer_key, %d,\n", nkey);
+    printf("\t    sizeof(usage_consumer_key[0]), usage_key_cmp);\n\n");
+    printf("\treturn (e != NULL ? e->usage : -1);\n");
+    printf("}\n");
+}
@@ -1,52 +1,104 @@
+function num(s,    n, i) {
+    if (s !~ /^0[xX]/)
+	return (s + 0)
+    n = 0
+    for (i = 3; i <= length(s); i++)
+	n = n * 16 + index("0123456789abcdef", tolower(substr(s, i, 1))) - 1
+    return (n)
+}
+
+function esc(s,    r, c, i) {
+    r = ""
+    for (i = 1; i <= length(s); i++) {
+	c = substr(s, i, 1)
+	if (c == "\\" || c == "\"")
+	    r = r "\\"
+	r = r c
+    }
+    return (r)
+}
+
+function endpage() {
+    if (sbegin == 1) {
+	if (n == 0)
+	    printf("\t0\n")
+	printf("};\n\n")
+	nusage[p] = n
+    }
+}
+
 BEGIN {
     printf("/* Generated by: awk -f usage_in_page.awk usb_hid_usages */\n\n");
     printf("const char *usage_in_page(int i, int j);\n\n");
-    printf("const char *\n")
-    printf("usage_in_page(int i, int j)\n")
-    printf("{\n")
-    printf("\tswitch(i) {\n")
     sbegin = 0;
+    npage = 0;
 }
 
 /^[0-9]/{
-    if (sbegin == 1) {
-	printf("\t\tdefault:\n")
-	printf("\t\t\treturn(\"Unknown Usage\");\n")
-	printf("\t\t}\n")
-	printf("\t\tbreak;\n")
-    }
-
+    endpage()
     sbegin = 1
     page = $2
-    printf("\tcase %s:\n", $1)
-    printf("\t\tswitch(j) {\n")
+    p = num($1)
+    n = 0
+    pages[npage++] = p
+    printf("static const char *const usage_%x[] = {\n", p)
 }
 
 /^[[:space:]]/{
     if ($1 == "*") {
-	for(i=1; i<=255; i++) {
-	    printf("\t\tcase 0x%x:\n", i);
-	    printf("\t\t\treturn(\"%s%d\");\n", page, i);
-	}
+	for(i=1; i<=255; i++)
+	    printf("\t[0x%02x] = \"%s%d\",\n", i, page, i);
+	u = 255
     } else {
-	printf("\t\tcase %s:\n", $1)
 	str = substr($0, index($0, $2), length)
-	gsub(/\\/, "\\\\", str)
-	gsub("\"", "\\\"", str)
-	printf("\t\t\treturn(\"%s\");\n", str);
+	str = esc(str)
+	u = num($1)
+	printf("\t[0x%02x] = \"%s\",\n", u, str);
     }
+    if (u >= n)
+	n = u + 1
 }
 
 END {
-    if (sbegin == 1) {
-	printf("\t\tdefault:\n")
-	printf("\t\t\treturn(\"Unknown Usage\");\n")
-	printf("\t\t}\n")
-	printf("\t\tbreak;\n")
-    }
+    endpage()
 
-    printf("\tdefault:\n")
-    printf("\t\treturn(\"Unknown Page\");\n")
-    printf("\t}\n")
+    # Dense index for the pages below 0x100, a short list for the rest.
+    nlow = 0
+    for (i = 0; i < npage; i++)
+	if (pages[i] < 256 && pages[i] >= nlow)
+	    nlow = pages[i] + 1
+    printf("static const struct {\n");
+    printf("\tconst char *const *name;\n");
+    printf("\tint n;\n");
+    printf("} page_usage[%d] = {\n", nlow);
+    for (i = 0; i < npage; i++)
+	if (pages[i] < 256)
+	    printf("\t[0x%02x] = { usage_%x, %d },\n", pages[i], pages[i],
+		nusage[pages[i]]);
+    printf("};\n\n");
+    printf("const char *\n")
+    printf("usage_in_page(int i, int j)\n")
+    printf("{\n")
+    printf("\tconst char *const *name;\n")
+    printf("\tint n;\n\n")
+    printf("\tif (i >= 0 && i < %d) {\n", nlow)
+    printf("\t\tname = page_usage[i].name;\n")
+    printf("\t\tn = page_usage[i].n;\n")
+    printf("\t}")
+    for (i = 0; i < npage; i++) {
+	if (pages[i] < 256)
+	    continue
+	printf(" else if (i == 0x%x) {\n", pages[i])
+	printf("\t\tname = usage_%x;\n", pages[i])
+	printf("\t\tn = %d;\n", nusage[pages[i]])
+	printf("\t}")
+    }
+    printf(" else\n")
+    printf("\t\tname = 0;\n")
+    printf("\tif (name == 0)\n")
+    printf("\t\treturn (\"Unknown Page\");\n")
+    printf("\tif (j < 0 || j >= n || name[j] == 0)\n")
+    printf("\t\treturn (\"Unknown Usage\");\n")
+    printf("\treturn (name[j]);\n")
     printf("}\n")
 }
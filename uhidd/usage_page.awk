@@ -1,6 +1,33 @@
+function num(s,    n, i) {
+    if (s !~ /^0[xX]/)
+	return (s + 0)
+    n = 0
+    for (i = 3; i <= length(s); i++)
+	n = n * 16 + index("0123456789abcdef", tolower(substr(s, i, 1))) - 1
+    return (n)
+}
+
 BEGIN {
     printf("/* Generated by: awk -f usage_page.awk usb_hid_usages */\n\n");
     printf("const char *usage_page(int i);\n\n");
+    npage = 0
+}
+
+/^[0-9]/{
+    p = num($1)
+    if (p > 255)
+	next
+    name[p] = substr($0, index($0, $2), length)
+    if (p >= npage)
+	npage = p + 1
+}
+
+END {
+    printf("static const char *const page_name[%d] = {\n", npage);
+    for (i = 0; i < npage; i++)
+	if (i in name)
+	    printf("\t[0x%02x] = \"%s\",\n", i, name[i]);
+    printf("};\n\n");
     printf("const char *\n");
     printf("usage_page(int i)\n");
     printf("{\n");
@@ -10,17 +37,8 @@ BEGIN {
     printf("\tif (i >= 0xFF00 && i <= 0xFFFF) {\n");
     printf("\t\treturn (\"Vendor\");\n");
     printf("\t}\n");
-    printf("\tswitch(i) {\n");
-}
-
-/^[0-9]/{
-    printf("\tcase %s:\n", $1);
-    printf("\t\treturn(\"%s\");\n", substr($0, index($0, $2), length));
-}
-
-END {
-    printf("\tdefault:\n");
-    printf("\t\treturn(\"Unknown Page\");\n");
-    printf("\t}\n");
+    printf("\tif (i < 0 || i >= %d || page_name[i] == 0)\n", npage);
+    printf("\t\treturn (\"Unknown Page\");\n");
+    printf("\treturn (page_name[i]);\n");
     printf("}\n");
 }